@@ -16,6 +16,7 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <target/mem_cache.h>
 
 /**
  * @file
@@ -31,6 +32,8 @@ int flash_driver_erase(struct flash_bank *bank, unsigned int first,
 {
 	int retval;
 
+	target_mem_cache_invalidate();
+
 	retval = bank->driver->erase(bank, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %u to %u", first, last);
@@ -75,6 +78,7 @@ int flash_driver_protect(struct flash_bank *bank, int set, unsigned int first,
 	 *
 	 * Drivers only receive valid protection block range.
 	 */
+	target_mem_cache_invalidate();
 	retval = bank->driver->protect(bank, set, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed setting protection for blocks %u to %u", first, last);
@@ -87,6 +91,8 @@ int flash_driver_write(struct flash_bank *bank,
 {
 	int retval;
 
+	target_mem_cache_invalidate();
+
 	retval = bank->driver->write(bank, buffer, offset, count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
@@ -727,10 +733,184 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
+/* Minimal amount of data programmed before the written sectors are verified */
+#define FLASH_VERIFY_GROUP_SIZE (64 * 1024)
+
+/**
+ * Return the end of the group of sectors starting at @a offset, covering at
+ * least FLASH_VERIFY_GROUP_SIZE bytes but not extending past @a end.
+ */
+static uint32_t flash_sector_group_end(struct flash_bank *bank,
+	uint32_t offset, uint32_t end)
+{
+	for (unsigned int sector = 0; sector < bank->num_sectors; sector++) {
+		uint32_t sector_end = bank->sectors[sector].offset
+			+ bank->sectors[sector].size;
+
+		if (sector_end > offset && sector_end - offset >= FLASH_VERIFY_GROUP_SIZE)
+			return MIN(sector_end, end);
+	}
+
+	return end;
+}
+
+/**
+ * Program @a count bytes at @a offset in groups of sectors and verify each
+ * group right after it has been written. A failure is thus detected as soon
+ * as the group is done, and each verification only checksums the data that
+ * has just been programmed instead of the whole run at the end.
+ */
+static int flash_write_verify_groups(struct flash_bank *bank,
+	const uint8_t *buffer, uint32_t offset, uint32_t count)
+{
+	uint32_t end = offset + count;
+
+	while (offset < end) {
+		uint32_t group_end = flash_sector_group_end(bank, offset, end);
+		uint32_t group_size = group_end - offset;
+
+		int retval = flash_driver_write(bank, buffer, offset, group_size);
+		if (retval != ERROR_OK)
+			return retval;
+
+		retval = flash_driver_verify(bank, buffer, offset, group_size);
+		if (retval != ERROR_OK)
+			return retval;
+
+		buffer += group_size;
+		offset = group_end;
+	}
+
+	return ERROR_OK;
+}
+
+/* unlock, erase, write and/or verify a range of a flash bank from @a buffer */
+static int flash_program_range(struct target *target, struct flash_bank *bank,
+	const uint8_t *buffer, target_addr_t address, uint32_t size,
+	bool erase, bool unlock, bool write, bool verify)
+{
+	int retval = ERROR_OK;
+
+	if (unlock)
+		retval = flash_unlock_address_range(target, address, size);
+	if (retval == ERROR_OK) {
+		if (erase) {
+			/* calculate and erase sectors */
+			retval = flash_erase_address_range(target,
+					true, address, size);
+		}
+	}
+
+	if (retval == ERROR_OK) {
+		if (write && verify) {
+			/* write and verify flash sectors group by group */
+			retval = flash_write_verify_groups(bank, buffer, address - bank->base, size);
+		} else if (write) {
+			/* write flash sectors */
+			retval = flash_driver_write(bank, buffer, address - bank->base, size);
+		} else if (verify) {
+			/* verify flash sectors */
+			retval = flash_driver_verify(bank, buffer, address - bank->base, size);
+		}
+	}
+
+	return retval;
+}
+
+struct flash_diff_stats {
+	unsigned int sectors;
+	unsigned int sectors_skipped;
+	uint32_t bytes_skipped;
+};
+
+/**
+ * Compare each sector covered by the run with the content of @a buffer,
+ * using target_checksum_memory(), and only program the ranges of
+ * consecutive sectors that differ.
+ */
+static int flash_program_changed_sectors(struct target *target, struct flash_bank *bank,
+	const uint8_t *buffer, target_addr_t address, uint32_t size,
+	bool erase, bool unlock, bool write, bool verify,
+	uint32_t *written, struct flash_diff_stats *stats)
+{
+	uint32_t run_start = address - bank->base;
+	uint32_t run_end = run_start + size;
+	uint32_t offset = run_start;
+	/* start of the pending range of changed sectors, run_end if none */
+	uint32_t changed_start = run_end;
+	/* set once the target cannot compute checksums, e.g. bank not memory mapped */
+	bool no_checksum = false;
+	int retval;
+
+	*written = 0;
+
+	while (offset < run_end) {
+		uint32_t sector_end = run_end;
+		for (unsigned int sector = 0; sector < bank->num_sectors; sector++) {
+			uint32_t end = bank->sectors[sector].offset + bank->sectors[sector].size;
+			if (end > offset) {
+				sector_end = MIN(end, run_end);
+				break;
+			}
+		}
+
+		uint32_t count = sector_end - offset;
+		const uint8_t *data = buffer + (offset - run_start);
+		uint32_t image_crc, target_crc;
+		bool unchanged = false;
+
+		if (!no_checksum) {
+			retval = image_calculate_checksum(data, count, &image_crc);
+			if (retval != ERROR_OK)
+				return retval;
+
+			/* sectors which cannot be compared are programmed */
+			retval = target_checksum_memory(target, bank->base + offset, count, &target_crc);
+			if (retval != ERROR_OK) {
+				LOG_WARNING("cannot compute the checksum of flash bank %s, "
+					"programming the remaining sectors", bank->name);
+				no_checksum = true;
+			} else {
+				unchanged = (image_crc == target_crc);
+			}
+		}
+
+		stats->sectors++;
+		if (unchanged) {
+			stats->sectors_skipped++;
+			stats->bytes_skipped += count;
+		} else if (changed_start == run_end) {
+			changed_start = offset;
+		}
+
+		offset = sector_end;
+
+		/* program the pending range when it ends */
+		if (changed_start != run_end && (unchanged || offset == run_end)) {
+			uint32_t changed_end = unchanged ? offset - count : offset;
+			uint32_t changed_size = changed_end - changed_start;
+
+			LOG_DEBUG("programming changed range at " TARGET_ADDR_FMT ", size 0x%" PRIx32,
+				bank->base + changed_start, changed_size);
+			retval = flash_program_range(target, bank, buffer + (changed_start - run_start),
+					bank->base + changed_start, changed_size,
+					erase, unlock, write, verify);
+			if (retval != ERROR_OK)
+				return retval;
+
+			*written += changed_size;
+			changed_start = run_end;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 int flash_write_unlock_verify(struct target *target, struct image *image,
-	uint32_t *written, bool erase, bool unlock, bool write, bool verify)
+	uint32_t *written, bool erase, bool unlock, bool write, bool verify, bool skip_unchanged)
 {
 	int retval = ERROR_OK;
+	struct flash_diff_stats diff_stats = { 0 };
 
 	unsigned int section;
 	uint32_t section_offset;
@@ -894,85 +1074,93 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			run_size += delta;
 		}
 
-		/* allocate buffer */
-		buffer = malloc(run_size);
-		if (!buffer) {
-			LOG_ERROR("Out of memory for flash bank buffer");
-			retval = ERROR_FAIL;
-			goto done;
-		}
-
-		if (padding_at_start)
-			memset(buffer, c->default_padded_value, padding_at_start);
+		const uint8_t *run_data = NULL;
+		buffer = NULL;
 
-		buffer_idx = padding_at_start;
+		/* a run made of a single section without padding is programmed
+		 * straight from the mapped file or the decoded image */
+		if (section_last == section && !padding_at_start && !padding[section]) {
+			int section_num = sections[section] - image->sections;
 
-		/* read sections to the buffer */
-		while (buffer_idx < run_size) {
-			size_t size_read;
-
-			size_read = run_size - buffer_idx;
-			if (size_read > sections[section]->size - section_offset)
-				size_read = sections[section]->size - section_offset;
+			if (image_get_section_data(image, section_num, section_offset,
+					run_size, &run_data) == ERROR_OK) {
+				section_offset += run_size;
+				if (section_offset >= sections[section]->size) {
+					section++;
+					section_offset = 0;
+				}
+			} else {
+				run_data = NULL;
+			}
+		}
 
-			/* KLUDGE!
-			 *
-			 * #¤%#"%¤% we have to figure out the section # from the sorted
-			 * list of pointers to sections to invoke image_read_section()...
-			 */
-			intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
-			int t_section_num = diff / sizeof(struct imagesection);
-
-			LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
-					"section_offset = %"PRIu32", buffer_idx = %"PRIu32", size_read = %zu",
-				section, t_section_num, section_offset,
-				buffer_idx, size_read);
-			retval = image_read_section(image, t_section_num, section_offset,
-					size_read, buffer + buffer_idx, &size_read);
-			if (retval != ERROR_OK || size_read == 0) {
-				free(buffer);
+		if (!run_data) {
+			/* allocate buffer */
+			buffer = malloc(run_size);
+			if (!buffer) {
+				LOG_ERROR("Out of memory for flash bank buffer");
+				retval = ERROR_FAIL;
 				goto done;
 			}
 
-			buffer_idx += size_read;
-			section_offset += size_read;
-
-			/* see if we need to pad the section */
-			if (padding[section]) {
-				memset(buffer + buffer_idx, c->default_padded_value, padding[section]);
-				buffer_idx += padding[section];
-			}
+			if (padding_at_start)
+				memset(buffer, c->default_padded_value, padding_at_start);
+
+			buffer_idx = padding_at_start;
+
+			/* read sections to the buffer */
+			while (buffer_idx < run_size) {
+				size_t size_read;
+
+				size_read = run_size - buffer_idx;
+				if (size_read > sections[section]->size - section_offset)
+					size_read = sections[section]->size - section_offset;
+
+				/* KLUDGE!
+				 *
+				 * #¤%#"%¤% we have to figure out the section # from the sorted
+				 * list of pointers to sections to invoke image_read_section()...
+				 */
+				intptr_t diff = (intptr_t)sections[section] - (intptr_t)image->sections;
+				int t_section_num = diff / sizeof(struct imagesection);
+
+				LOG_DEBUG("image_read_section: section = %d, t_section_num = %d, "
+						"section_offset = %"PRIu32", buffer_idx = %"PRIu32", size_read = %zu",
+					section, t_section_num, section_offset,
+					buffer_idx, size_read);
+				retval = image_read_section(image, t_section_num, section_offset,
+						size_read, buffer + buffer_idx, &size_read);
+				if (retval != ERROR_OK || size_read == 0) {
+					free(buffer);
+					goto done;
+				}
 
-			if (section_offset >= sections[section]->size) {
-				section++;
-				section_offset = 0;
-			}
-		}
+				buffer_idx += size_read;
+				section_offset += size_read;
 
-		retval = ERROR_OK;
+				/* see if we need to pad the section */
+				if (padding[section]) {
+					memset(buffer + buffer_idx, c->default_padded_value, padding[section]);
+					buffer_idx += padding[section];
+				}
 
-		if (unlock)
-			retval = flash_unlock_address_range(target, run_address, run_size);
-		if (retval == ERROR_OK) {
-			if (erase) {
-				/* calculate and erase sectors */
-				retval = flash_erase_address_range(target,
-						true, run_address, run_size);
+				if (section_offset >= sections[section]->size) {
+					section++;
+					section_offset = 0;
+				}
 			}
-		}
 
-		if (retval == ERROR_OK) {
-			if (write) {
-				/* write flash sectors */
-				retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
-			}
+			run_data = buffer;
 		}
 
-		if (retval == ERROR_OK) {
-			if (verify) {
-				/* verify flash sectors */
-				retval = flash_driver_verify(c, buffer, run_address - c->base, run_size);
-			}
+		if (skip_unchanged) {
+			uint32_t run_written = 0;
+			retval = flash_program_changed_sectors(target, c, run_data, run_address, run_size,
+					erase, unlock, write, verify, &run_written, &diff_stats);
+			run_size = run_written;
+		} else {
+			retval = flash_program_range(target, c, run_data, run_address, run_size,
+					erase, unlock, write, verify);
 		}
 
 		free(buffer);
@@ -986,6 +1174,10 @@ int flash_write_unlock_verify(struct target *target, struct image *image,
 			*written += run_size;	/* add run size to total written counter */
 	}
 
+	if (skip_unchanged)
+		LOG_INFO("%u of %u sectors unchanged and skipped, %" PRIu32 " bytes not programmed",
+			diff_stats.sectors_skipped, diff_stats.sectors, diff_stats.bytes_skipped);
+
 done:
 	free(sections);
 	free(padding);
@@ -996,7 +1188,7 @@ done:
 int flash_write(struct target *target, struct image *image,
 	uint32_t *written, bool erase)
 {
-	return flash_write_unlock_verify(target, image, written, erase, false, true, false);
+	return flash_write_unlock_verify(target, image, written, erase, false, true, false, false);
 }
 
 struct flash_sector *alloc_block_array(uint32_t offset, uint32_t size,
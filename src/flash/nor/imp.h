@@ -37,8 +37,12 @@ int flash_driver_read(struct flash_bank *bank,
 int flash_driver_verify(struct flash_bank *bank,
 		const uint8_t *buffer, uint32_t offset, uint32_t count);
 
-/* write (optional verify) an image to flash memory of the given target */
+/* write (optional verify) an image to flash memory of the given target.
+ * When both write and verify are set, each group of sectors is verified
+ * right after being programmed. With skip_unchanged set, only the sectors whose
+ * checksum differs from the image are unlocked, erased and programmed. */
 int flash_write_unlock_verify(struct target *target, struct image *image,
-		uint32_t *written, bool erase, bool unlock, bool write, bool verify);
+		uint32_t *written, bool erase, bool unlock, bool write, bool verify,
+		bool skip_unchanged);
 
 #endif /* OPENOCD_FLASH_NOR_IMP_H */
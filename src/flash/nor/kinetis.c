@@ -1315,21 +1315,20 @@ static int kinetis_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	uint8_t fstat;
 
 	/* allocate working area with flash programming code */
-	if (target_alloc_working_area(target, sizeof(kinetis_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_algorithm(target, kinetis_flash_write_code,
+			sizeof(kinetis_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-		sizeof(kinetis_flash_write_code), kinetis_flash_write_code);
-	if (retval != ERROR_OK)
+	} else if (retval != ERROR_OK) {
 		return retval;
+	}
 
 	/* memory buffer, size *must* be multiple of word */
 	buffer_size = target_get_working_area_avail(target) & ~(sizeof(uint32_t) - 1);
 	if (buffer_size < 256) {
 		LOG_WARNING("large enough working area not available, can't do block memory writes");
+		target_free_algorithm(target, write_algorithm);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	} else if (buffer_size > 16384) {
 		/* probably won't benefit from more than 16k ... */
@@ -1338,6 +1337,7 @@ static int kinetis_write_block(struct flash_bank *bank, const uint8_t *buffer,
 
 	if (target_alloc_working_area(target, buffer_size, &source) != ERROR_OK) {
 		LOG_ERROR("allocating working area failed");
+		target_free_algorithm(target, write_algorithm);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
@@ -1379,7 +1379,7 @@ static int kinetis_write_block(struct flash_bank *bank, const uint8_t *buffer,
 		LOG_ERROR("Error executing kinetis Flash programming algorithm");
 
 	target_free_working_area(target, source);
-	target_free_working_area(target, write_algorithm);
+	target_free_algorithm(target, write_algorithm);
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
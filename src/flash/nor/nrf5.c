@@ -1144,8 +1144,9 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 	assert(bytes % 4 == 0);
 
 	/* allocate working area with flash programming code */
-	if (target_alloc_working_area(target, sizeof(nrf5_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_algorithm(target, nrf5_flash_write_code,
+			sizeof(nrf5_flash_write_code), &write_algorithm);
+	if (retval != ERROR_OK) {
 		LOG_WARNING("no working area available, falling back to slow memory writes");
 
 		for (; bytes > 0; bytes -= 4) {
@@ -1164,19 +1165,13 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 		return ERROR_OK;
 	}
 
-	retval = target_write_buffer(target, write_algorithm->address,
-				sizeof(nrf5_flash_write_code),
-				nrf5_flash_write_code);
-	if (retval != ERROR_OK)
-		return retval;
-
 	/* memory buffer */
 	while (target_alloc_working_area(target, buffer_size, &source) != ERROR_OK) {
 		buffer_size /= 2;
 		buffer_size &= ~3UL; /* Make sure it's 4 byte aligned */
 		if (buffer_size <= 256) {
 			/* free working area, write algorithm already allocated */
-			target_free_working_area(target, write_algorithm);
+			target_free_algorithm(target, write_algorithm);
 
 			LOG_WARNING("No large enough working area available, can't do block memory writes");
 			return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
@@ -1208,7 +1203,7 @@ static int nrf5_ll_flash_write(struct nrf5_info *chip, uint32_t address, const u
 			&armv7m_info);
 
 	target_free_working_area(target, source);
-	target_free_working_area(target, write_algorithm);
+	target_free_algorithm(target, write_algorithm);
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
@@ -458,16 +458,12 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 	};
 
 	/* flash write code */
-	if (target_alloc_working_area(target, sizeof(stm32x_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_algorithm(target, stm32x_flash_write_code,
+			sizeof(stm32x_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32x_flash_write_code), stm32x_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+	} else if (retval != ERROR_OK) {
 		return retval;
 	}
 
@@ -484,7 +480,7 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 	retval = target_alloc_working_area(target, buffer_size, &source);
 	/* Allocated size is always 32-bit word aligned */
 	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+		target_free_algorithm(target, write_algorithm);
 		LOG_WARNING("no large enough working area available, can't do block memory writes");
 		/* target_alloc_working_area() may return ERROR_FAIL if area backup fails:
 		 * convert any error to ERROR_TARGET_RESOURCE_NOT_AVAILABLE
@@ -535,7 +531,7 @@ static int stm32x_write_block_async(struct flash_bank *bank, const uint8_t *buff
 		destroy_reg_param(&reg_params[i]);
 
 	target_free_working_area(target, source);
-	target_free_working_area(target, write_algorithm);
+	target_free_algorithm(target, write_algorithm);
 
 	return retval;
 }
@@ -552,16 +548,12 @@ static int stm32x_write_block_riscv(struct flash_bank *bank, const uint8_t *buff
 	};
 
 	/* flash write code */
-	if (target_alloc_working_area(target, sizeof(gd32vf103_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	int retval = target_alloc_algorithm(target, gd32vf103_flash_write_code,
+			sizeof(gd32vf103_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	int retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(gd32vf103_flash_write_code), gd32vf103_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+	} else if (retval != ERROR_OK) {
 		return retval;
 	}
 
@@ -572,7 +564,7 @@ static int stm32x_write_block_riscv(struct flash_bank *bank, const uint8_t *buff
 	retval = target_alloc_working_area(target, buffer_size, &source);
 	/* Allocated size is always word aligned */
 	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+		target_free_algorithm(target, write_algorithm);
 		LOG_WARNING("no large enough working area available, can't do block memory writes");
 		/* target_alloc_working_area() may return ERROR_FAIL if area backup fails:
 		 * convert any error to ERROR_TARGET_RESOURCE_NOT_AVAILABLE
@@ -638,7 +630,7 @@ static int stm32x_write_block_riscv(struct flash_bank *bank, const uint8_t *buff
 		destroy_reg_param(&reg_params[i]);
 
 	target_free_working_area(target, source);
-	target_free_working_area(target, write_algorithm);
+	target_free_algorithm(target, write_algorithm);
 
 	return retval;
 }
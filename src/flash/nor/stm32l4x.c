@@ -1449,17 +1449,12 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 #include "../../../contrib/loaders/flash/stm32/stm32l4x.inc"
 	};
 
-	if (target_alloc_working_area(target, sizeof(stm32l4_flash_write_code),
-			&write_algorithm) != ERROR_OK) {
+	retval = target_alloc_algorithm(target, stm32l4_flash_write_code,
+			sizeof(stm32l4_flash_write_code), &write_algorithm);
+	if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE) {
 		LOG_WARNING("no working area available, can't do block memory writes");
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
-	}
-
-	retval = target_write_buffer(target, write_algorithm->address,
-			sizeof(stm32l4_flash_write_code),
-			stm32l4_flash_write_code);
-	if (retval != ERROR_OK) {
-		target_free_working_area(target, write_algorithm);
+	} else if (retval != ERROR_OK) {
 		return retval;
 	}
 
@@ -1472,7 +1467,7 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 
 	if (buffer_size < 256) {
 		LOG_WARNING("large enough working area not available, can't do block memory writes");
-		target_free_working_area(target, write_algorithm);
+		target_free_algorithm(target, write_algorithm);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	} else if (buffer_size > 16384) {
 		/* probably won't benefit from more than 16k ... */
@@ -1481,6 +1476,7 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 
 	if (target_alloc_working_area_try(target, buffer_size + extra_size, &source) != ERROR_OK) {
 		LOG_ERROR("allocating working area failed");
+		target_free_algorithm(target, write_algorithm);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 
@@ -1546,7 +1542,7 @@ static int stm32l4_write_block(struct flash_bank *bank, const uint8_t *buffer,
 	}
 
 	target_free_working_area(target, source);
-	target_free_working_area(target, write_algorithm);
+	target_free_algorithm(target, write_algorithm);
 
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
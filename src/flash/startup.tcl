@@ -68,17 +68,21 @@ proc program {filename args} {
 	if {$needsflash == 1} {
 		echo "** Programming Started **"
 
-		if {[catch {eval flash write_image erase $flash_args}] == 0} {
+		# verify each group of sectors right after writing it, instead of
+		# reading the whole image back in a second pass
+		if {[info exists verify]} {
+			set write_args "erase verify"
+		} else {
+			set write_args "erase"
+		}
+
+		if {[catch {eval flash write_image $write_args $flash_args}] == 0} {
 			echo "** Programming Finished **"
 			if {[info exists verify]} {
-				# verify phase
-				echo "** Verify Started **"
-				if {[catch {eval verify_image $flash_args}] == 0} {
-					echo "** Verified OK **"
-				} else {
-					program_error "** Verify Failed **" $exit
-				}
+				echo "** Verified OK **"
 			}
+		} elseif {[info exists verify]} {
+			program_error "** Programming or Verify Failed **" $exit
 		} else {
 			program_error "** Programming Failed **" $exit
 		}
@@ -379,22 +379,58 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
  */
 size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 {
-	size_t i;
-	uint8_t tmp;
+	size_t i, n;
 
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
-		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
-		hex[i] = hex_digits[tmp];
+	/* whole bytes first, then a possible leading nibble if truncated */
+	n = MIN(count, (length - 1) / 2);
+	for (i = 0; i < n; i++) {
+		hex[2 * i] = hex_digits[bin[i] >> 4];
+		hex[2 * i + 1] = hex_digits[bin[i] & 0x0f];
 	}
 
+	i = 2 * n;
+	if (i < length - 1 && n < count)
+		hex[i++] = hex_digits[bin[n] >> 4];
+
 	hex[i] = 0;
 
 	return i;
 }
 
+/**
+ * Convert binary data into hexadecimal pairs and compute, in the same pass,
+ * the modulo 256 sum of the produced characters as used by GDB packets.
+ *
+ * The conversion can be done in place: @p bin may point inside @p hex as
+ * long as it is at least @p count bytes after its start.
+ *
+ * @param[out] hex Buffer to store the 2 * @p count hexadecimal characters,
+ *                 no null-terminator is added.
+ * @param[in] bin Buffer with binary data to convert into hexadecimal pairs.
+ * @param[in] count Number of bytes to convert.
+ *
+ * @returns The sum of the hexadecimal characters, truncated to 8 bits.
+ */
+uint8_t hexify_sum(char *hex, const uint8_t *bin, size_t count)
+{
+	unsigned int sum = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		uint8_t tmp = bin[i];
+		char hi = hex_digits[tmp >> 4];
+		char lo = hex_digits[tmp & 0x0f];
+
+		hex[2 * i] = hi;
+		hex[2 * i + 1] = lo;
+		sum += (uint8_t)hi + (uint8_t)lo;
+	}
+
+	return sum & 0xff;
+}
+
 void buffer_shr(void *_buf, unsigned buf_len, unsigned count)
 {
 	unsigned i;
@@ -13,9 +13,99 @@
 #endif
 
 #include "crc32.h"
+#include "types.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+/*
+ * Slice-by-8 lookup tables for the two polynomials in use. Table 0 is the
+ * classic byte-at-a-time table, table k gives the CRC of a byte followed by
+ * k zero bytes. They are filled on first use.
+ */
+static uint32_t crc32_le_table[8][256];
+static uint32_t crc32_be_table[8][256];
+static bool crc32_le_table_ready;
+static bool crc32_be_table_ready;
+
+static void crc32_le_init_table(void)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY_LE : (c >> 1);
+		crc32_le_table[0][i] = c;
+	}
+
+	for (unsigned int i = 0; i < 256; i++)
+		for (unsigned int k = 1; k < 8; k++) {
+			uint32_t c = crc32_le_table[k - 1][i];
+			crc32_le_table[k][i] = (c >> 8) ^ crc32_le_table[0][c & 0xff];
+		}
+
+	crc32_le_table_ready = true;
+}
+
+static void crc32_be_init_table(void)
+{
+	for (unsigned int i = 0; i < 256; i++) {
+		uint32_t c = i << 24;
+		for (unsigned int j = 0; j < 8; j++)
+			c = (c & 0x80000000) ? (c << 1) ^ CRC32_POLY_BE : (c << 1);
+		crc32_be_table[0][i] = c;
+	}
+
+	for (unsigned int i = 0; i < 256; i++)
+		for (unsigned int k = 1; k < 8; k++) {
+			uint32_t c = crc32_be_table[k - 1][i];
+			crc32_be_table[k][i] = (c << 8) ^ crc32_be_table[0][c >> 24];
+		}
+
+	crc32_be_table_ready = true;
+}
+
+static uint32_t crc32_le_slice8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	if (!crc32_le_table_ready)
+		crc32_le_init_table();
+
+	const uint32_t (*t)[256] = crc32_le_table;
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		crc ^= le_to_h_u32(data);
+		crc = t[7][crc & 0xff] ^ t[6][(crc >> 8) & 0xff] ^
+			t[5][(crc >> 16) & 0xff] ^ t[4][crc >> 24] ^
+			t[3][data[4]] ^ t[2][data[5]] ^
+			t[1][data[6]] ^ t[0][data[7]];
+	}
+
+	while (data_len--)
+		crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+
+	return crc;
+}
+
+static uint32_t crc32_be_slice8(uint32_t crc, const uint8_t *data, size_t data_len)
+{
+	if (!crc32_be_table_ready)
+		crc32_be_init_table();
+
+	const uint32_t (*t)[256] = crc32_be_table;
+
+	for (; data_len >= 8; data_len -= 8, data += 8) {
+		crc ^= be_to_h_u32(data);
+		crc = t[7][crc >> 24] ^ t[6][(crc >> 16) & 0xff] ^
+			t[5][(crc >> 8) & 0xff] ^ t[4][crc & 0xff] ^
+			t[3][data[4]] ^ t[2][data[5]] ^
+			t[1][data[6]] ^ t[0][data[7]];
+	}
+
+	while (data_len--)
+		crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+
+	return crc;
+}
+
 static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 		unsigned int data_bits)
 {
@@ -30,9 +120,24 @@ static uint32_t crc_le_step(uint32_t poly, uint32_t crc, uint32_t data_in,
 	return crc;
 }
 
+static uint32_t crc_be_step(uint32_t poly, uint32_t crc, uint8_t data_in)
+{
+	crc ^= (uint32_t)data_in << 24;
+	for (unsigned int i = 0; i < 8; i++)
+		crc = (crc & 0x80000000) ? (crc << 1) ^ poly : (crc << 1);
+
+	return crc;
+}
+
 uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 		size_t data_len)
 {
+#ifndef WORDS_BIGENDIAN
+	/* the 32 bit path below matches the byte-wise CRC on little endian hosts only */
+	if (poly == CRC32_POLY_LE)
+		return crc32_le_slice8(seed, _data, data_len);
+#endif
+
 	if (((uintptr_t)_data & 0x3) || (data_len & 0x3)) {
 		/* data is unaligned, processing data one byte at a time */
 		const uint8_t *data = _data;
@@ -48,3 +153,16 @@ uint32_t crc32_le(uint32_t poly, uint32_t seed, const void *_data,
 
 	return seed;
 }
+
+uint32_t crc32_be(uint32_t poly, uint32_t seed, const void *_data,
+		size_t data_len)
+{
+	if (poly == CRC32_POLY_BE)
+		return crc32_be_slice8(seed, _data, data_len);
+
+	const uint8_t *data = _data;
+	for (size_t i = 0; i < data_len; i++)
+		seed = crc_be_step(poly, seed, data[i]);
+
+	return seed;
+}
@@ -16,6 +16,7 @@
 #include "minidriver.h"
 #include "interface.h"
 #include "interfaces.h"
+#include "commands.h"
 #include <transport/transport.h>
 
 /**
@@ -194,6 +195,8 @@ int adapter_quit(void)
 	free(adapter_config.serial);
 	free(adapter_config.usb_location);
 
+	jtag_ir_cache_invalidate();
+
 	struct jtag_tap *t = jtag_all_taps();
 	while (t) {
 		struct jtag_tap *n = t->next_tap;
@@ -201,6 +204,8 @@ int adapter_quit(void)
 		t = n;
 	}
 
+	jtag_command_queue_free();
+
 	return ERROR_OK;
 }
 
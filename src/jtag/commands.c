@@ -26,16 +26,31 @@
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
+	size_t size;
 	size_t used;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
 static struct cmd_queue_page *cmd_queue_pages;
-static struct cmd_queue_page *cmd_queue_pages_tail;
+/* page currently being filled, NULL when the queue is empty */
+static struct cmd_queue_page *cmd_queue_cur_page;
+
+/*
+ * In arena mode the pages are rewound on queue reset instead of being
+ * released, so a steady flow of queue flushes does not hit the allocator.
+ * Oversized pages, allocated for a single huge request, are still freed.
+ */
+static bool cmd_queue_arena = true;
+static struct cmd_queue_stats cmd_queue_stats;
+static size_t cmd_queue_bytes;
+static unsigned int cmd_queue_pages_used;
 
 static struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
 
+static bool cmd_queue_optimize;
+static struct cmd_queue_opt_stats cmd_queue_opt_stats;
+
 void jtag_queue_command(struct jtag_command *cmd)
 {
 	if (!transport_is_jtag()) {
@@ -65,8 +80,7 @@ void jtag_queue_command(struct jtag_command *cmd)
 
 void *cmd_queue_alloc(size_t size)
 {
-	struct cmd_queue_page **p_page = &cmd_queue_pages;
-	int offset;
+	size_t offset;
 	uint8_t *t;
 
 	/*
@@ -101,26 +115,48 @@ void *cmd_queue_alloc(size_t size)
 	size = (size + ALIGN_SIZE - 1) & (~(ALIGN_SIZE - 1));
 	/* Done... */
 
-	if (*p_page) {
-		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE < (*p_page)->used + size)
-			p_page = &((*p_page)->next);
-	}
+	struct cmd_queue_page *page = cmd_queue_cur_page;
+
+	if (!page || page->size - page->used < size) {
+		/* move on to the next retained page, if it is large enough */
+		struct cmd_queue_page **p_next = page ? &page->next : &cmd_queue_pages;
+
+		if (*p_next && (*p_next)->size >= size) {
+			page = *p_next;
+			cmd_queue_stats.page_reuses++;
+		} else {
+			page = malloc(sizeof(struct cmd_queue_page));
+			if (!page) {
+				LOG_ERROR("Out of memory");
+				return NULL;
+			}
+			page->size = (size < CMD_QUEUE_PAGE_SIZE) ? CMD_QUEUE_PAGE_SIZE : size;
+			page->address = malloc(page->size);
+			if (!page->address) {
+				LOG_ERROR("Out of memory");
+				free(page);
+				return NULL;
+			}
+			page->used = 0;
+			page->next = *p_next;
+			*p_next = page;
+			cmd_queue_stats.page_allocs++;
+		}
 
-	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
-					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
-		cmd_queue_pages_tail = *p_page;
+		cmd_queue_cur_page = page;
+		cmd_queue_pages_used++;
+		if (cmd_queue_stats.pages_high_water < cmd_queue_pages_used)
+			cmd_queue_stats.pages_high_water = cmd_queue_pages_used;
 	}
 
-	offset = (*p_page)->used;
-	(*p_page)->used += size;
+	offset = page->used;
+	page->used += size;
 
-	t = (*p_page)->address;
+	cmd_queue_bytes += size;
+	if (cmd_queue_stats.bytes_high_water < cmd_queue_bytes)
+		cmd_queue_stats.bytes_high_water = cmd_queue_bytes;
+
+	t = page->address;
 	return t + offset;
 }
 
@@ -136,12 +172,41 @@ static void cmd_queue_free(void)
 	}
 
 	cmd_queue_pages = NULL;
-	cmd_queue_pages_tail = NULL;
+	cmd_queue_cur_page = NULL;
+}
+
+/* Keep the pages for the next queue, only drop the oversized ones */
+static void cmd_queue_rewind(void)
+{
+	struct cmd_queue_page **p_page = &cmd_queue_pages;
+
+	while (*p_page) {
+		struct cmd_queue_page *page = *p_page;
+
+		if (page->size > CMD_QUEUE_PAGE_SIZE) {
+			*p_page = page->next;
+			free(page->address);
+			free(page);
+			continue;
+		}
+
+		page->used = 0;
+		p_page = &page->next;
+	}
+
+	cmd_queue_cur_page = NULL;
 }
 
 void jtag_command_queue_reset(void)
 {
-	cmd_queue_free();
+	if (cmd_queue_arena)
+		cmd_queue_rewind();
+	else
+		cmd_queue_free();
+
+	cmd_queue_stats.resets++;
+	cmd_queue_bytes = 0;
+	cmd_queue_pages_used = 0;
 
 	jtag_command_queue = NULL;
 	next_command_pointer = &jtag_command_queue;
@@ -152,6 +217,207 @@ struct jtag_command *jtag_command_queue_get(void)
 	return jtag_command_queue;
 }
 
+void jtag_command_queue_free(void)
+{
+	cmd_queue_free();
+}
+
+void jtag_command_queue_set_arena(bool enable)
+{
+	cmd_queue_arena = enable;
+}
+
+bool jtag_command_queue_uses_arena(void)
+{
+	return cmd_queue_arena;
+}
+
+void jtag_command_queue_get_stats(struct cmd_queue_stats *stats)
+{
+	*stats = cmd_queue_stats;
+
+	stats->pages_retained = 0;
+	stats->bytes_retained = 0;
+	for (struct cmd_queue_page *page = cmd_queue_pages; page; page = page->next) {
+		stats->pages_retained++;
+		stats->bytes_retained += page->size;
+	}
+}
+
+void jtag_command_queue_set_optimize(bool enable)
+{
+	cmd_queue_optimize = enable;
+}
+
+bool jtag_command_queue_optimizes(void)
+{
+	return cmd_queue_optimize;
+}
+
+void jtag_command_queue_get_opt_stats(struct cmd_queue_opt_stats *stats)
+{
+	*stats = cmd_queue_opt_stats;
+}
+
+static bool jtag_scan_has_input(const struct scan_command *cmd)
+{
+	for (unsigned int i = 0; i < cmd->num_fields; i++)
+		if (cmd->fields[i].in_value)
+			return true;
+
+	return false;
+}
+
+/* Compare the bits shifted out by two scans, whatever their split in fields */
+static bool jtag_scan_out_equal(const struct scan_command *a, const struct scan_command *b)
+{
+	if (jtag_scan_size(a) != jtag_scan_size(b))
+		return false;
+
+	unsigned int ia = 0, ib = 0;
+	unsigned int offset_a = 0, offset_b = 0;
+	while (ia < a->num_fields && ib < b->num_fields) {
+		const struct scan_field *fa = &a->fields[ia];
+		const struct scan_field *fb = &b->fields[ib];
+		unsigned int len = MIN(MIN(fa->num_bits - offset_a, fb->num_bits - offset_b), 32);
+
+		/* a NULL out_value shifts zeros */
+		uint32_t va = fa->out_value ? buf_get_u32(fa->out_value, offset_a, len) : 0;
+		uint32_t vb = fb->out_value ? buf_get_u32(fb->out_value, offset_b, len) : 0;
+		if (va != vb)
+			return false;
+
+		offset_a += len;
+		offset_b += len;
+		if (offset_a == fa->num_bits) {
+			ia++;
+			offset_a = 0;
+		}
+		if (offset_b == fb->num_bits) {
+			ib++;
+			offset_b = 0;
+		}
+	}
+
+	return true;
+}
+
+/* Merge runs of fields that neither send nor capture data, like the one bit
+ * fields generated for the TAPs in BYPASS during a DR scan */
+static void jtag_scan_merge_fields(struct scan_command *cmd)
+{
+	unsigned int num_fields = 0;
+
+	for (unsigned int i = 0; i < cmd->num_fields; i++) {
+		struct scan_field *field = &cmd->fields[i];
+		struct scan_field *last = num_fields ? &cmd->fields[num_fields - 1] : NULL;
+
+		if (last && !last->out_value && !last->in_value
+				&& !field->out_value && !field->in_value) {
+			last->num_bits += field->num_bits;
+			continue;
+		}
+
+		if (num_fields != i)
+			cmd->fields[num_fields] = *field;
+		num_fields++;
+	}
+
+	cmd_queue_opt_stats.fields_merged += cmd->num_fields - num_fields;
+	cmd->num_fields = num_fields;
+}
+
+/*
+ * The passes below only rely on what the queue itself tells about the TAP
+ * state, the state and instruction at the start of the queue are unknown.
+ * An IR scan is dropped when it shifts the same bits as the previous IR
+ * scan of the queue, captures nothing and leaves the TAP in the state it
+ * already is in: the only difference is that Update-IR is not visited
+ * again. Consecutive RUNTEST commands looping in Run-Test/Idle are folded
+ * and so are consecutive STABLECLOCKS commands.
+ */
+void jtag_command_queue_optimize(void)
+{
+	if (!cmd_queue_optimize || !jtag_command_queue)
+		return;
+
+	struct jtag_command *prev = NULL;
+	struct jtag_command *cmd = jtag_command_queue;
+	const struct scan_command *last_ir = NULL;
+	tap_state_t state = TAP_INVALID;
+
+	cmd_queue_opt_stats.queues++;
+
+	while (cmd) {
+		struct jtag_command *next = cmd->next;
+		bool drop = false;
+
+		cmd_queue_opt_stats.commands_in++;
+
+		switch (cmd->type) {
+		case JTAG_SCAN:
+			cmd_queue_opt_stats.scan_bits_in += jtag_scan_size(cmd->cmd.scan);
+
+			if (cmd->cmd.scan->ir_scan) {
+				if (last_ir && state != TAP_INVALID
+						&& cmd->cmd.scan->end_state == state
+						&& !jtag_scan_has_input(cmd->cmd.scan)
+						&& jtag_scan_out_equal(cmd->cmd.scan, last_ir)) {
+					cmd_queue_opt_stats.ir_scans_dropped++;
+					drop = true;
+					break;
+				}
+				last_ir = cmd->cmd.scan;
+			}
+
+			jtag_scan_merge_fields(cmd->cmd.scan);
+			cmd_queue_opt_stats.scan_bits_out += jtag_scan_size(cmd->cmd.scan);
+			state = cmd->cmd.scan->end_state;
+			break;
+		case JTAG_RUNTEST:
+			if (prev && prev->type == JTAG_RUNTEST
+					&& prev->cmd.runtest->end_state == TAP_IDLE
+					&& prev->cmd.runtest->num_cycles <= UINT_MAX - cmd->cmd.runtest->num_cycles) {
+				prev->cmd.runtest->num_cycles += cmd->cmd.runtest->num_cycles;
+				prev->cmd.runtest->end_state = cmd->cmd.runtest->end_state;
+				cmd_queue_opt_stats.clocks_folded++;
+				drop = true;
+			}
+			state = cmd->cmd.runtest->end_state;
+			break;
+		case JTAG_STABLECLOCKS:
+			if (prev && prev->type == JTAG_STABLECLOCKS
+					&& prev->cmd.stableclocks->num_cycles <= UINT_MAX - cmd->cmd.stableclocks->num_cycles) {
+				prev->cmd.stableclocks->num_cycles += cmd->cmd.stableclocks->num_cycles;
+				cmd_queue_opt_stats.clocks_folded++;
+				drop = true;
+			}
+			break;
+		case JTAG_SLEEP:
+			break;
+		case JTAG_TLR_RESET:
+			state = TAP_RESET;
+			last_ir = NULL;
+			break;
+		default:
+			/* the TAP may have gone through Test-Logic-Reset or Shift-IR */
+			state = TAP_INVALID;
+			last_ir = NULL;
+			break;
+		}
+
+		if (drop) {
+			prev->next = next;
+		} else {
+			cmd_queue_opt_stats.commands_out++;
+			prev = cmd;
+		}
+		cmd = next;
+	}
+
+	next_command_pointer = &prev->next;
+}
+
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
@@ -149,11 +149,71 @@ struct jtag_command {
 	struct jtag_command *next;
 };
 
+/**
+ * Usage counters of the pages backing cmd_queue_alloc().
+ */
+struct cmd_queue_stats {
+	/** Number of pages obtained from malloc(). */
+	uint64_t page_allocs;
+	/** Number of times an already allocated page has been recycled. */
+	uint64_t page_reuses;
+	/** Number of queue resets. */
+	uint64_t resets;
+	/** Largest number of bytes allocated by a single queue. */
+	size_t bytes_high_water;
+	/** Largest number of pages used by a single queue. */
+	unsigned int pages_high_water;
+	/** Pages currently kept by the allocator. */
+	unsigned int pages_retained;
+	/** Bytes currently kept by the allocator. */
+	size_t bytes_retained;
+};
+
+/**
+ * Counters of the queue optimizer, see jtag_command_queue_optimize().
+ */
+struct cmd_queue_opt_stats {
+	/** Number of queues processed. */
+	uint64_t queues;
+	/** Number of commands before and after optimization. */
+	uint64_t commands_in;
+	uint64_t commands_out;
+	/** Number of scanned bits before and after optimization. */
+	uint64_t scan_bits_in;
+	uint64_t scan_bits_out;
+	/** IR scans dropped because they reload the current instruction. */
+	uint64_t ir_scans_dropped;
+	/** RUNTEST and STABLECLOCKS commands folded into the previous one. */
+	uint64_t clocks_folded;
+	/** Scan fields merged with the previous field of the same scan. */
+	uint64_t fields_merged;
+};
+
 void *cmd_queue_alloc(size_t size);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
 struct jtag_command *jtag_command_queue_get(void);
+/** Release all the memory held by the command queue allocator. */
+void jtag_command_queue_free(void);
+
+/**
+ * Select whether the command queue pages are recycled across queue resets
+ * (arena mode) or released on each reset.
+ */
+void jtag_command_queue_set_arena(bool enable);
+bool jtag_command_queue_uses_arena(void);
+void jtag_command_queue_get_stats(struct cmd_queue_stats *stats);
+
+/**
+ * Rewrite the queued commands into an equivalent, cheaper sequence before
+ * they are handed to the adapter driver. Does nothing unless enabled with
+ * jtag_command_queue_set_optimize().
+ */
+void jtag_command_queue_optimize(void);
+void jtag_command_queue_set_optimize(bool enable);
+bool jtag_command_queue_optimizes(void);
+void jtag_command_queue_get_opt_stats(struct cmd_queue_opt_stats *stats);
 
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
@@ -90,6 +90,14 @@ tap_state_t cmd_queue_cur_state = TAP_RESET;
 static bool jtag_verify_capture_ir = true;
 static bool jtag_verify = true;
 
+/* Skip the IR scans that reload the instructions already in the TAPs,
+ * opt-in as some callers (PLD drivers, SVF files) rely on every Update-IR */
+static bool jtag_ir_cache;
+static uint64_t jtag_ir_cache_skips;
+/* last plain IR scan of the whole chain, valid while not NULL */
+static uint8_t *jtag_plain_ir_cache;
+static unsigned int jtag_plain_ir_cache_bits;
+
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
  *deasserted (in ms) */
 static unsigned int adapter_nsrst_delay;	/* default to no nSRST delay */
@@ -353,13 +361,61 @@ static void jtag_prelude(tap_state_t state)
 	cmd_queue_cur_state = state;
 }
 
+void jtag_ir_cache_invalidate(void)
+{
+	for (struct jtag_tap *tap = __jtag_all_taps; tap; tap = tap->next_tap)
+		tap->cur_instr_valid = false;
+
+	free(jtag_plain_ir_cache);
+	jtag_plain_ir_cache = NULL;
+}
+
+/*
+ * An IR scan can be skipped when it would not change the instruction of any
+ * TAP of the chain and leaves the TAP state machine where it already is.
+ * The active TAP must hold the requested instruction and all the other
+ * enabled TAPs must be in BYPASS, as loaded by interface_jtag_add_ir_scan().
+ */
+static bool jtag_ir_scan_is_redundant(struct jtag_tap *active,
+	const struct scan_field *in_fields, tap_state_t state)
+{
+	if (!jtag_ir_cache || state != cmd_queue_cur_state)
+		return false;
+
+	if (in_fields->in_value || !in_fields->out_value
+			|| in_fields->num_bits != active->ir_length)
+		return false;
+
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap; tap = jtag_tap_next_enabled(tap)) {
+		if (!tap->cur_instr_valid)
+			return false;
+		if (tap != active && !tap->bypass)
+			return false;
+	}
+
+	return active->enabled &&
+		!buf_cmp(active->cur_instr, in_fields->out_value, active->ir_length);
+}
+
 void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
 	tap_state_t state)
 {
+	if (jtag_ir_scan_is_redundant(active, in_fields, state)) {
+		jtag_ir_cache_skips++;
+		return;
+	}
+
 	jtag_prelude(state);
 
 	int retval = interface_jtag_add_ir_scan(active, in_fields, state);
 	jtag_set_error(retval);
+
+	/* the IR of all the enabled TAPs has been loaded */
+	for (struct jtag_tap *tap = __jtag_all_taps; tap; tap = tap->next_tap)
+		tap->cur_instr_valid = tap->enabled;
+
+	free(jtag_plain_ir_cache);
+	jtag_plain_ir_cache = NULL;
 }
 
 static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
@@ -395,11 +451,24 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 	assert(out_bits);
 	assert(state != TAP_RESET);
 
+	if (jtag_ir_cache && jtag_plain_ir_cache && !in_bits
+			&& state == cmd_queue_cur_state
+			&& jtag_plain_ir_cache_bits == (unsigned int)num_bits
+			&& !buf_cmp(jtag_plain_ir_cache, out_bits, num_bits)) {
+		jtag_ir_cache_skips++;
+		return;
+	}
+
 	jtag_prelude(state);
 
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
 	jtag_set_error(retval);
+
+	/* cur_instr of the TAPs is not updated by plain scans */
+	jtag_ir_cache_invalidate();
+	jtag_plain_ir_cache = buf_cpy(out_bits, malloc(DIV_ROUND_UP(num_bits, 8)), num_bits);
+	jtag_plain_ir_cache_bits = num_bits;
 }
 
 static int jtag_check_value_inner(uint8_t *captured, uint8_t *in_check_value,
@@ -508,6 +577,7 @@ int jtag_add_tms_seq(unsigned int nbits, const uint8_t *seq, enum tap_state stat
 
 	jtag_checks();
 	cmd_queue_cur_state = state;
+	jtag_ir_cache_invalidate();
 
 	retval = interface_add_tms_seq(nbits, seq, state);
 	jtag_set_error(retval);
@@ -540,6 +610,10 @@ void jtag_add_pathmove(unsigned int num_states, const tap_state_t *path)
 			return;
 		}
 		cur_state = path[i];
+
+		/* Capture-IR and Update-IR can change the instructions */
+		if (cur_state == TAP_IRCAPTURE || cur_state == TAP_IRUPDATE)
+			jtag_ir_cache_invalidate();
 	}
 
 	jtag_checks();
@@ -951,6 +1025,8 @@ int default_interface_jtag_execute_queue(void)
 			return ERROR_OK;
 	}
 
+	jtag_command_queue_optimize();
+
 	struct jtag_command *cmd = jtag_command_queue_get();
 	int result = adapter_driver->jtag_ops->execute_queue(cmd);
 
@@ -1018,7 +1094,12 @@ int default_interface_jtag_execute_queue(void)
 void jtag_execute_queue_noclear(void)
 {
 	jtag_flush_queue_count++;
-	jtag_set_error(interface_jtag_execute_queue());
+
+	int retval = interface_jtag_execute_queue();
+	/* the scans may not have reached the TAPs */
+	if (retval != ERROR_OK)
+		jtag_ir_cache_invalidate();
+	jtag_set_error(retval);
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -1049,7 +1130,11 @@ static int jtag_reset_callback(enum jtag_event event, void *priv)
 
 		/* current instruction is either BYPASS or IDCODE */
 		buf_set_ones(tap->cur_instr, tap->ir_length);
+		tap->cur_instr_valid = false;
 		tap->bypass = true;
+
+		free(jtag_plain_ir_cache);
+		jtag_plain_ir_cache = NULL;
 	}
 
 	return ERROR_OK;
@@ -1708,6 +1793,21 @@ bool jtag_will_verify_capture_ir(void)
 	return jtag_verify_capture_ir;
 }
 
+void jtag_set_ir_cache(bool enable)
+{
+	jtag_ir_cache = enable;
+}
+
+bool jtag_will_cache_ir(void)
+{
+	return jtag_ir_cache;
+}
+
+uint64_t jtag_get_ir_cache_skips(void)
+{
+	return jtag_ir_cache_skips;
+}
+
 int jtag_power_dropout(int *dropout)
 {
 	if (!is_adapter_initialized()) {
@@ -29,6 +29,7 @@
 
 #include <transport/transport.h>
 #include "helper/replacements.h"
+#include <helper/time_support.h>
 #include <jtag/adapter.h>
 #include <jtag/swd.h>
 #include <jtag/interface.h>
@@ -250,6 +251,13 @@ static uint8_t queued_seq_buf[1024]; /* TODO: make dynamic / move into cmsis obj
 
 static int queued_retval;
 
+/* SWD packets sent since the last queue flush, for throughput reporting */
+static struct {
+	struct duration duration;
+	unsigned int packets;
+	unsigned int transfers;
+} flush_stats;
+
 static uint8_t output_pins = SWJ_PIN_SRST | SWJ_PIN_TRST;
 
 static struct cmsis_dap *cmsis_dap_handle;
@@ -341,6 +349,8 @@ static int cmsis_dap_xfer(struct cmsis_dap *dap, int txlen)
 			dap->backend->read(dap, 10, NULL);
 			dap->pending_fifo_block_count--;
 		}
+		/* drop the responses read ahead, the indexes restart from 0 */
+		dap->backend->cancel_all(dap);
 		dap->pending_fifo_put_idx = 0;
 		dap->pending_fifo_get_idx = 0;
 	}
@@ -761,7 +771,10 @@ static int cmsis_dap_cmd_dap_swo_data(
 
 static void cmsis_dap_swd_discard_all_pending(struct cmsis_dap *dap)
 {
-	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++)
+	/* no outstanding response may complete for the requests restarting at index 0 */
+	dap->backend->cancel_all(dap);
+
+	for (unsigned int i = 0; i < dap->packet_count; i++)
 		dap->pending_fifo[i].transfer_count = 0;
 
 	dap->pending_fifo_put_idx = 0;
@@ -855,12 +868,18 @@ static void cmsis_dap_swd_write_from_queue(struct cmsis_dap *dap)
 		}
 	}
 
+	if (dap->pending_fifo_block_count == 0 && flush_stats.packets == 0)
+		duration_start(&flush_stats.duration);
+
 	int retval = dap->backend->write(dap, idx, LIBUSB_TIMEOUT_MS);
 	if (retval < 0) {
 		queued_retval = retval;
 		goto skip;
 	}
 
+	flush_stats.packets++;
+	flush_stats.transfers += block->transfer_count;
+
 	unsigned int packet_count = dap->quirk_mode ? 1 : dap->packet_count;
 	dap->pending_fifo_put_idx = (dap->pending_fifo_put_idx + 1) % packet_count;
 	dap->pending_fifo_block_count++;
@@ -1005,6 +1024,16 @@ static int cmsis_dap_swd_run_queue(void)
 	cmsis_dap_handle->pending_fifo_put_idx = 0;
 	cmsis_dap_handle->pending_fifo_get_idx = 0;
 
+	if (flush_stats.packets) {
+		duration_measure(&flush_stats.duration);
+		LOG_DEBUG_IO("flushed %u transfers in %u packets (up to %u in flight), %.3f KiB/s",
+			flush_stats.transfers, flush_stats.packets,
+			cmsis_dap_handle->quirk_mode ? 1 : cmsis_dap_handle->packet_count,
+			duration_kbps(&flush_stats.duration, 4 * flush_stats.transfers));
+		flush_stats.packets = 0;
+		flush_stats.transfers = 0;
+	}
+
 	int retval = queued_retval;
 	queued_retval = ERROR_OK;
 
@@ -1353,21 +1382,37 @@ static int cmsis_dap_init(void)
 	 * until we get packet count info from the adaptor */
 	cmsis_dap_handle->packet_count = 1;
 
+	/* INFO_ID_PKT_CNT - byte */
+	retval = cmsis_dap_cmd_dap_info(INFO_ID_PKT_CNT, &data);
+	if (retval != ERROR_OK)
+		goto init_err;
+
+	unsigned int pkt_cnt = 1;
+	if (data[0] == 1) { /* byte */
+		pkt_cnt = MAX(data[1], 1);
+		LOG_DEBUG("CMSIS-DAP: Packet Count = %u", pkt_cnt);
+	}
+
 	/* INFO_ID_PKT_SZ - short */
 	retval = cmsis_dap_cmd_dap_info(INFO_ID_PKT_SZ, &data);
 	if (retval != ERROR_OK)
 		goto init_err;
 
+	unsigned int pkt_sz = cmsis_dap_handle->packet_size;
 	if (data[0] == 2) {  /* short */
-		uint16_t pkt_sz = data[1] + (data[2] << 8);
-		if (pkt_sz != cmsis_dap_handle->packet_size) {
-			cmsis_dap_handle->backend->packet_buffer_free(cmsis_dap_handle);
-			retval = cmsis_dap_handle->backend->packet_buffer_alloc(cmsis_dap_handle, pkt_sz);
-			if (retval != ERROR_OK)
-				goto init_err;
+		pkt_sz = data[1] + (data[2] << 8);
+		LOG_DEBUG("CMSIS-DAP: Packet Size = %u", pkt_sz);
+	}
 
-			LOG_DEBUG("CMSIS-DAP: Packet Size = %" PRIu16, pkt_sz);
-		}
+	/* Keep as many requests in flight as the adapter has packet buffers.
+	 * The backend sizes its per packet buffers from packet_count, so they
+	 * are reallocated even if the packet size did not change */
+	cmsis_dap_handle->packet_count = MIN(MAX_PENDING_REQUESTS, pkt_cnt);
+	if (pkt_sz != cmsis_dap_handle->packet_size || cmsis_dap_handle->packet_count > 1) {
+		cmsis_dap_handle->backend->packet_buffer_free(cmsis_dap_handle);
+		retval = cmsis_dap_handle->backend->packet_buffer_alloc(cmsis_dap_handle, pkt_sz);
+		if (retval != ERROR_OK)
+			goto init_err;
 	}
 
 	/* Maximal number of transfers which fit to one packet:
@@ -1380,19 +1425,6 @@ static int cmsis_dap_init(void)
 	cmsis_dap_handle->write_count = 0;
 	cmsis_dap_handle->read_count = 0;
 
-	/* INFO_ID_PKT_CNT - byte */
-	retval = cmsis_dap_cmd_dap_info(INFO_ID_PKT_CNT, &data);
-	if (retval != ERROR_OK)
-		goto init_err;
-
-	if (data[0] == 1) { /* byte */
-		unsigned int pkt_cnt = data[1];
-		if (pkt_cnt > 1)
-			cmsis_dap_handle->packet_count = MIN(MAX_PENDING_REQUESTS, pkt_cnt);
-
-		LOG_DEBUG("CMSIS-DAP: Packet Count = %u", pkt_cnt);
-	}
-
 	LOG_DEBUG("Allocating FIFO for %u pending packets", cmsis_dap_handle->packet_count);
 	for (unsigned int i = 0; i < cmsis_dap_handle->packet_count; i++) {
 		cmsis_dap_handle->pending_fifo[i].transfers = malloc(pending_queue_len
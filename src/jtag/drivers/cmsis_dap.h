@@ -15,8 +15,10 @@ struct pending_transfer_result {
 };
 
 /* Up to MIN(packet_count, MAX_PENDING_REQUESTS) requests may be issued
- * until the first response arrives */
-#define MAX_PENDING_REQUESTS 4
+ * until the first response arrives. The packet count advertised by the
+ * adapter is the number of command buffers it has, so the limit here only
+ * protects against nonsensical values */
+#define MAX_PENDING_REQUESTS 64
 
 struct pending_request_block {
 	struct pending_transfer_result *transfers;
@@ -28,11 +28,15 @@
 #include <libusb.h>
 #include <helper/log.h>
 #include <helper/replacements.h>
+#include <helper/time_support.h>
 #include <jtag/jtag.h>	/* ERROR_JTAG_DEVICE_ERROR only */
 
 #include "cmsis_dap.h"
 #include "libusb_helper.h"
 
+/* Maximum time to wait for libusb to give back a cancelled transfer */
+#define CMSIS_DAP_USB_CANCEL_TIMEOUT_MS	1000
+
 enum {
 	CMSIS_DAP_TRANSFER_PENDING = 0,	/* must be 0, used in libusb_handle_events_completed */
 	CMSIS_DAP_TRANSFER_IDLE,
@@ -55,6 +59,8 @@ struct cmsis_dap_backend_data {
 
 	struct cmsis_dap_bulk_transfer command_transfers[MAX_PENDING_REQUESTS];
 	struct cmsis_dap_bulk_transfer response_transfers[MAX_PENDING_REQUESTS];
+	/* number of transfers with a buffer, one per packet in flight */
+	unsigned int transfer_count;
 };
 
 static int cmsis_dap_usb_interface = -1;
@@ -440,6 +446,48 @@ static void LIBUSB_CALL cmsis_dap_usb_callback(struct libusb_transfer *transfer)
 	}
 }
 
+/* Process the events until a cancelled transfer has been given back by libusb,
+ * a transfer cannot be submitted again before */
+static void cmsis_dap_usb_wait_cancelled(struct cmsis_dap *dap,
+										 struct cmsis_dap_bulk_transfer *tr)
+{
+	int64_t deadline = timeval_ms() + CMSIS_DAP_USB_CANCEL_TIMEOUT_MS;
+
+	while (tr->status == CMSIS_DAP_TRANSFER_PENDING && timeval_ms() < deadline) {
+		struct timeval tv = {
+			.tv_sec = 0,
+			.tv_usec = 10000
+		};
+		if (libusb_handle_events_timeout_completed(dap->bdata->usb_ctx, &tv, &tr->status))
+			break;
+	}
+
+	if (tr->status == CMSIS_DAP_TRANSFER_PENDING)
+		LOG_ERROR("USB transfer could not be cancelled");
+}
+
+static int cmsis_dap_usb_submit_read(struct cmsis_dap *dap, unsigned int idx,
+									 int transfer_timeout_ms)
+{
+	struct cmsis_dap_bulk_transfer *tr = &dap->bdata->response_transfers[idx];
+
+	libusb_fill_bulk_transfer(tr->transfer,
+							  dap->bdata->dev_handle, dap->bdata->ep_in,
+							  tr->buffer, dap->packet_size,
+							  &cmsis_dap_usb_callback, tr,
+							  transfer_timeout_ms);
+	LOG_DEBUG_IO("submit read @ %u", idx);
+	tr->status = CMSIS_DAP_TRANSFER_PENDING;
+	int err = libusb_submit_transfer(tr->transfer);
+	if (err) {
+		tr->status = CMSIS_DAP_TRANSFER_IDLE;
+		LOG_ERROR("error submitting USB read: %s", libusb_strerror(err));
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
 static int cmsis_dap_usb_read(struct cmsis_dap *dap, int transfer_timeout_ms,
 							  struct timeval *wait_timeout)
 {
@@ -448,26 +496,19 @@ static int cmsis_dap_usb_read(struct cmsis_dap *dap, int transfer_timeout_ms,
 	struct cmsis_dap_bulk_transfer *tr;
 	tr = &dap->bdata->response_transfers[dap->pending_fifo_get_idx];
 
+	/* The read is normally submitted together with its command,
+	 * see cmsis_dap_usb_write() */
 	if (tr->status == CMSIS_DAP_TRANSFER_IDLE) {
-		libusb_fill_bulk_transfer(tr->transfer,
-								  dap->bdata->dev_handle, dap->bdata->ep_in,
-								  tr->buffer, dap->packet_size,
-								  &cmsis_dap_usb_callback, tr,
-								  transfer_timeout_ms);
-		LOG_DEBUG_IO("submit read @ %u", dap->pending_fifo_get_idx);
-		tr->status = CMSIS_DAP_TRANSFER_PENDING;
-		err = libusb_submit_transfer(tr->transfer);
-		if (err) {
-			tr->status = CMSIS_DAP_TRANSFER_IDLE;
-			LOG_ERROR("error submitting USB read: %s", libusb_strerror(err));
-			return ERROR_FAIL;
-		}
+		err = cmsis_dap_usb_submit_read(dap, dap->pending_fifo_get_idx, transfer_timeout_ms);
+		if (err != ERROR_OK)
+			return err;
 	}
 
 	struct timeval tv = {
 		.tv_sec = transfer_timeout_ms / 1000,
 		.tv_usec = transfer_timeout_ms % 1000 * 1000
 	};
+	int64_t deadline = timeval_ms() + transfer_timeout_ms;
 
 	while (tr->status == CMSIS_DAP_TRANSFER_PENDING) {
 		err = libusb_handle_events_timeout_completed(dap->bdata->usb_ctx,
@@ -479,6 +520,17 @@ static int cmsis_dap_usb_read(struct cmsis_dap *dap, int transfer_timeout_ms,
 		}
 		if (wait_timeout)
 			break;
+
+		/* A read submitted with its command has the timeout of the command,
+		 * enforce the one of the caller, e.g. short reads draining the adapter */
+		if (tr->status == CMSIS_DAP_TRANSFER_PENDING && timeval_ms() >= deadline) {
+			libusb_cancel_transfer(tr->transfer);
+			cmsis_dap_usb_wait_cancelled(dap, tr);
+			if (tr->status == CMSIS_DAP_TRANSFER_PENDING)
+				return ERROR_JTAG_DEVICE_ERROR;
+			if (tr->status != CMSIS_DAP_TRANSFER_COMPLETED)
+				tr->status = ERROR_TIMEOUT_REACHED;
+		}
 	}
 
 	if (tr->status < 0 || tr->status == CMSIS_DAP_TRANSFER_COMPLETED) {
@@ -574,6 +626,12 @@ static int cmsis_dap_usb_write(struct cmsis_dap *dap, int txlen, int timeout_ms)
 		return ERROR_FAIL;
 	}
 
+	/* Queue the response read right away: libusb completes it in the
+	 * background while the next packets are built, so with several packets
+	 * in flight the adapter never waits for the host to ask for a response */
+	if (dap->bdata->response_transfers[dap->pending_fifo_put_idx].status == CMSIS_DAP_TRANSFER_IDLE)
+		return cmsis_dap_usb_submit_read(dap, dap->pending_fifo_put_idx, timeout_ms);
+
 	return ERROR_OK;
 }
 
@@ -593,8 +651,10 @@ static int cmsis_dap_usb_alloc(struct cmsis_dap *dap, unsigned int pkt_sz)
 	dap->command = dap->packet_buffer;
 	dap->response = dap->packet_buffer;
 
+	/* One buffer per packet the adapter accepts in flight */
 	struct cmsis_dap_backend_data *bdata = dap->bdata;
-	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++) {
+	bdata->transfer_count = MAX(MIN(dap->packet_count, MAX_PENDING_REQUESTS), 1);
+	for (unsigned int i = 0; i < bdata->transfer_count; i++) {
 		bdata->command_transfers[i].buffer =
 			oocd_libusb_dev_mem_alloc(bdata->dev_handle, pkt_sz);
 
@@ -614,7 +674,7 @@ static void cmsis_dap_usb_free(struct cmsis_dap *dap)
 {
 	struct cmsis_dap_backend_data *bdata = dap->bdata;
 
-	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++) {
+	for (unsigned int i = 0; i < bdata->transfer_count; i++) {
 		oocd_libusb_dev_mem_free(bdata->dev_handle,
 			bdata->command_transfers[i].buffer, dap->packet_size);
 		oocd_libusb_dev_mem_free(bdata->dev_handle,
@@ -622,6 +682,7 @@ static void cmsis_dap_usb_free(struct cmsis_dap *dap)
 		bdata->command_transfers[i].buffer = NULL;
 		bdata->response_transfers[i].buffer = NULL;
 	}
+	bdata->transfer_count = 0;
 
 	free(dap->packet_buffer);
 	dap->packet_buffer = NULL;
@@ -631,14 +692,26 @@ static void cmsis_dap_usb_free(struct cmsis_dap *dap)
 
 static void cmsis_dap_usb_cancel_all(struct cmsis_dap *dap)
 {
+	struct cmsis_dap_backend_data *bdata = dap->bdata;
+
+	/* the responses are read ahead, see cmsis_dap_usb_write(), cancel all
+	 * of them so that none completes with the response of a later command */
 	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++) {
-		if (dap->bdata->command_transfers[i].status == CMSIS_DAP_TRANSFER_PENDING)
-			libusb_cancel_transfer(dap->bdata->command_transfers[i].transfer);
-		if (dap->bdata->response_transfers[i].status == CMSIS_DAP_TRANSFER_PENDING)
-			libusb_cancel_transfer(dap->bdata->response_transfers[i].transfer);
+		if (bdata->command_transfers[i].status == CMSIS_DAP_TRANSFER_PENDING)
+			libusb_cancel_transfer(bdata->command_transfers[i].transfer);
+		if (bdata->response_transfers[i].status == CMSIS_DAP_TRANSFER_PENDING)
+			libusb_cancel_transfer(bdata->response_transfers[i].transfer);
+	}
 
-		dap->bdata->command_transfers[i].status = CMSIS_DAP_TRANSFER_IDLE;
-		dap->bdata->response_transfers[i].status = CMSIS_DAP_TRANSFER_IDLE;
+	for (unsigned int i = 0; i < MAX_PENDING_REQUESTS; i++) {
+		cmsis_dap_usb_wait_cancelled(dap, &bdata->command_transfers[i]);
+		cmsis_dap_usb_wait_cancelled(dap, &bdata->response_transfers[i]);
+
+		/* a transfer still owned by libusb must not be submitted again */
+		if (bdata->command_transfers[i].status != CMSIS_DAP_TRANSFER_PENDING)
+			bdata->command_transfers[i].status = CMSIS_DAP_TRANSFER_IDLE;
+		if (bdata->response_transfers[i].status != CMSIS_DAP_TRANSFER_PENDING)
+			bdata->response_transfers[i].status = CMSIS_DAP_TRANSFER_IDLE;
 	}
 }
 
@@ -84,6 +84,7 @@ static uint8_t ftdi_channel;
 static uint8_t ftdi_jtag_mode = JTAG_MODE;
 
 static bool swd_mode;
+static bool ftdi_streaming = true;
 
 #define MAX_USB_IDS 8
 /* vid = pid = 0 marks the end of the list */
@@ -663,6 +664,8 @@ static int ftdi_initialize(void)
 	if (!mpsse_ctx)
 		return ERROR_JTAG_INIT_FAILED;
 
+	mpsse_set_streaming(mpsse_ctx, ftdi_streaming);
+
 	output = jtag_output_init;
 	direction = jtag_direction_init;
 
@@ -917,6 +920,22 @@ COMMAND_HANDLER(ftdi_handle_tdo_sample_edge_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(ftdi_handle_streaming_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], ftdi_streaming);
+		if (mpsse_ctx)
+			mpsse_set_streaming(mpsse_ctx, ftdi_streaming);
+	}
+
+	command_print(CMD, "ftdi streaming is %s", ftdi_streaming ? "enabled" : "disabled");
+
+	return ERROR_OK;
+}
+
 static const struct command_registration ftdi_subcommand_handlers[] = {
 	{
 		.name = "device_desc",
@@ -978,6 +997,14 @@ static const struct command_registration ftdi_subcommand_handlers[] = {
 			"allow signalling speed increase)",
 		.usage = "(rising|falling)",
 	},
+	{
+		.name = "streaming",
+		.handler = &ftdi_handle_streaming_command,
+		.mode = COMMAND_ANY,
+		.help = "send the commands that need no read-back without waiting "
+			"for the previous USB transfers to complete",
+		.usage = "['enable'|'disable']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -52,6 +52,21 @@
 #define SIO_RESET_PURGE_RX 1
 #define SIO_RESET_PURGE_TX 2
 
+/* Number of write buffers that can be in flight while streaming */
+#define MPSSE_STREAM_BUFFERS 3
+
+struct mpsse_ctx;
+
+/* Write buffer sent asynchronously, when it needs no read-back */
+struct mpsse_stream_buffer {
+	struct mpsse_ctx *ctx;
+	struct libusb_transfer *transfer;
+	uint8_t *buffer;
+	unsigned count;
+	unsigned transferred;
+	bool busy;
+};
+
 struct mpsse_ctx {
 	struct libusb_context *usb_ctx;
 	struct libusb_device_handle *usb_dev;
@@ -73,8 +88,121 @@ struct mpsse_ctx {
 	unsigned read_chunk_size;
 	struct bit_copy_queue read_queue;
 	int retval;
+	struct libusb_transfer *write_transfer;
+	struct libusb_transfer *read_transfer;
+	bool streaming;
+	struct mpsse_stream_buffer stream[MPSSE_STREAM_BUFFERS];
+	unsigned stream_next;
+	int stream_retval;
 };
 
+static LIBUSB_CALL void stream_write_cb(struct libusb_transfer *transfer)
+{
+	struct mpsse_stream_buffer *stream = transfer->user_data;
+	struct mpsse_ctx *ctx = stream->ctx;
+
+	stream->transferred += transfer->actual_length;
+
+	LOG_DEBUG_IO("streamed %d of %d", stream->transferred, stream->count);
+
+	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
+
+	/* Resubmitting the tail would queue it behind the other streams
+	 * in flight and reorder the command stream, fail the stream instead */
+	if (stream->transferred < stream->count) {
+		LOG_ERROR("ftdi device did not accept all data: %d, tried %d",
+			stream->transferred, stream->count);
+		ctx->stream_retval = ERROR_FAIL;
+	}
+
+	stream->busy = false;
+}
+
+static bool stream_busy(struct mpsse_ctx *ctx, const struct mpsse_stream_buffer *stream)
+{
+	if (stream)
+		return stream->busy;
+
+	for (unsigned i = 0; i < MPSSE_STREAM_BUFFERS; i++)
+		if (ctx->stream[i].busy)
+			return true;
+
+	return false;
+}
+
+/* Wait until a streamed buffer, or all of them if stream is NULL, has been sent */
+static int stream_wait(struct mpsse_ctx *ctx, const struct mpsse_stream_buffer *stream)
+{
+	int64_t start = timeval_ms();
+	int64_t warn_after = 2000;
+
+	while (stream_busy(ctx, stream)) {
+		struct timeval timeout_usb;
+
+		timeout_usb.tv_sec = 1;
+		timeout_usb.tv_usec = 0;
+
+		int retval = libusb_handle_events_timeout_completed(ctx->usb_ctx, &timeout_usb, NULL);
+		keep_alive();
+
+		int64_t now = timeval_ms();
+		if (now - start > warn_after) {
+			LOG_WARNING("Haven't made progress in mpsse streaming for %" PRId64
+					"ms.", now - start);
+			warn_after *= 2;
+		}
+
+		if (retval == LIBUSB_SUCCESS || retval == LIBUSB_ERROR_INTERRUPTED)
+			continue;
+
+		LOG_ERROR("libusb_handle_events() failed with %s", libusb_error_name(retval));
+		ctx->stream_retval = ERROR_FAIL;
+		for (unsigned i = 0; i < MPSSE_STREAM_BUFFERS; i++)
+			if (ctx->stream[i].busy)
+				libusb_cancel_transfer(ctx->stream[i].transfer);
+	}
+
+	return ctx->stream_retval;
+}
+
+/* Send the write buffer without waiting for the transfer to complete. The
+ * buffer is handed over to a stream slot and replaced by the slot's free one,
+ * so the next commands can be queued while the previous ones are sent. */
+static int stream_write(struct mpsse_ctx *ctx)
+{
+	struct mpsse_stream_buffer *stream = &ctx->stream[ctx->stream_next];
+
+	assert(ctx->read_count == 0);
+
+	if (stream_wait(ctx, stream) != ERROR_OK) {
+		mpsse_purge(ctx);
+		return ERROR_FAIL;
+	}
+
+	uint8_t *buffer = stream->buffer;
+	stream->buffer = ctx->write_buffer;
+	ctx->write_buffer = buffer;
+
+	stream->count = ctx->write_count;
+	stream->transferred = 0;
+	ctx->write_count = 0;
+	bit_copy_discard(&ctx->read_queue);
+
+	libusb_fill_bulk_transfer(stream->transfer, ctx->usb_dev, ctx->out_ep, stream->buffer,
+		stream->count, stream_write_cb, stream, ctx->usb_write_timeout);
+	int retval = libusb_submit_transfer(stream->transfer);
+	if (retval != LIBUSB_SUCCESS) {
+		LOG_ERROR("libusb_submit_transfer() failed with %s", libusb_error_name(retval));
+		mpsse_purge(ctx);
+		return ERROR_FAIL;
+	}
+
+	stream->busy = true;
+	ctx->stream_next = (ctx->stream_next + 1) % MPSSE_STREAM_BUFFERS;
+
+	return ERROR_OK;
+}
+
 /* Returns true if the string descriptor indexed by str_index in device matches string */
 static bool string_descriptor_equal(struct libusb_device_handle *device, uint8_t str_index,
 	const char *string)
@@ -352,6 +480,22 @@ struct mpsse_ctx *mpsse_open(const uint16_t vids[], const uint16_t pids[], const
 	if (!ctx->read_chunk || !ctx->read_buffer || !ctx->write_buffer)
 		goto error;
 
+	ctx->write_transfer = libusb_alloc_transfer(0);
+	ctx->read_transfer = libusb_alloc_transfer(0);
+	if (!ctx->write_transfer || !ctx->read_transfer)
+		goto error;
+
+	ctx->streaming = true;
+	for (unsigned i = 0; i < MPSSE_STREAM_BUFFERS; i++) {
+		struct mpsse_stream_buffer *stream = &ctx->stream[i];
+
+		stream->ctx = ctx;
+		stream->buffer = calloc(1, ctx->write_size);
+		stream->transfer = libusb_alloc_transfer(0);
+		if (!stream->buffer || !stream->transfer)
+			goto error;
+	}
+
 	ctx->interface = channel;
 	ctx->index = channel + 1;
 	ctx->usb_read_timeout = 5000;
@@ -404,12 +548,21 @@ error:
 
 void mpsse_close(struct mpsse_ctx *ctx)
 {
-	if (ctx->usb_dev)
+	if (ctx->usb_dev) {
+		stream_wait(ctx, NULL);
 		libusb_close(ctx->usb_dev);
+	}
 	if (ctx->usb_ctx)
 		libusb_exit(ctx->usb_ctx);
 	bit_copy_discard(&ctx->read_queue);
 
+	for (unsigned i = 0; i < MPSSE_STREAM_BUFFERS; i++) {
+		libusb_free_transfer(ctx->stream[i].transfer);
+		free(ctx->stream[i].buffer);
+	}
+	libusb_free_transfer(ctx->write_transfer);
+	libusb_free_transfer(ctx->read_transfer);
+
 	free(ctx->write_buffer);
 	free(ctx->read_buffer);
 	free(ctx->read_chunk);
@@ -421,13 +574,20 @@ bool mpsse_is_high_speed(struct mpsse_ctx *ctx)
 	return ctx->type != TYPE_FT2232C;
 }
 
+void mpsse_set_streaming(struct mpsse_ctx *ctx, bool enable)
+{
+	ctx->streaming = enable;
+}
+
 void mpsse_purge(struct mpsse_ctx *ctx)
 {
 	int err;
 	LOG_DEBUG("-");
+	stream_wait(ctx, NULL);
 	ctx->write_count = 0;
 	ctx->read_count = 0;
 	ctx->retval = ERROR_OK;
+	ctx->stream_retval = ERROR_OK;
 	bit_copy_discard(&ctx->read_queue);
 	err = libusb_control_transfer(ctx->usb_dev, FTDI_DEVICE_OUT_REQTYPE, SIO_RESET_REQUEST,
 			SIO_RESET_PURGE_RX, ctx->index, NULL, 0, ctx->usb_write_timeout);
@@ -483,6 +643,16 @@ static unsigned buffer_add_read(struct mpsse_ctx *ctx, uint8_t *in, unsigned in_
 	return bit_count;
 }
 
+/* Make room in the buffers while queuing commands */
+static int buffer_flush(struct mpsse_ctx *ctx)
+{
+	/* Commands without read-back do not need to wait for the transfer */
+	if (ctx->streaming && ctx->read_count == 0 && ctx->write_count > 0)
+		return stream_write(ctx);
+
+	return mpsse_flush(ctx);
+}
+
 void mpsse_clock_data_out(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_offset,
 	unsigned length, uint8_t mode)
 {
@@ -516,7 +686,7 @@ void mpsse_clock_data(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_of
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) + (length < 8) < (out || (!out && !in) ? 4 : 3)
 				|| (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = buffer_flush(ctx);
 
 		if (length < 8) {
 			/* Transfer remaining bits in bit mode */
@@ -590,7 +760,7 @@ void mpsse_clock_tms_cs(struct mpsse_ctx *ctx, const uint8_t *out, unsigned out_
 	while (length > 0) {
 		/* Guarantee buffer space enough for a minimum size transfer */
 		if (buffer_write_space(ctx) < 3 || (in && buffer_read_space(ctx) < 1))
-			ctx->retval = mpsse_flush(ctx);
+			ctx->retval = buffer_flush(ctx);
 
 		/* Byte transfer */
 		unsigned this_bits = length;
@@ -633,7 +803,7 @@ void mpsse_set_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t d
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = buffer_flush(ctx);
 
 	buffer_write_byte(ctx, 0x80);
 	buffer_write_byte(ctx, data);
@@ -650,7 +820,7 @@ void mpsse_set_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t data, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = buffer_flush(ctx);
 
 	buffer_write_byte(ctx, 0x82);
 	buffer_write_byte(ctx, data);
@@ -667,7 +837,7 @@ void mpsse_read_data_bits_low_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = buffer_flush(ctx);
 
 	buffer_write_byte(ctx, 0x81);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -683,7 +853,7 @@ void mpsse_read_data_bits_high_byte(struct mpsse_ctx *ctx, uint8_t *data)
 	}
 
 	if (buffer_write_space(ctx) < 1 || buffer_read_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = buffer_flush(ctx);
 
 	buffer_write_byte(ctx, 0x83);
 	buffer_add_read(ctx, data, 0, 8, 0);
@@ -698,7 +868,7 @@ static void single_byte_boolean_helper(struct mpsse_ctx *ctx, bool var, uint8_t
 	}
 
 	if (buffer_write_space(ctx) < 1)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = buffer_flush(ctx);
 
 	buffer_write_byte(ctx, var ? val_if_true : val_if_false);
 }
@@ -719,7 +889,7 @@ void mpsse_set_divisor(struct mpsse_ctx *ctx, uint16_t divisor)
 	}
 
 	if (buffer_write_space(ctx) < 3)
-		ctx->retval = mpsse_flush(ctx);
+		ctx->retval = buffer_flush(ctx);
 
 	buffer_write_byte(ctx, 0x86);
 	buffer_write_byte(ctx, divisor & 0xff);
@@ -820,7 +990,8 @@ static LIBUSB_CALL void read_cb(struct libusb_transfer *transfer)
 		ctx->read_count);
 
 	if (!res->done)
-		if (libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
+		if (transfer->status == LIBUSB_TRANSFER_CANCELLED ||
+				libusb_submit_transfer(transfer) != LIBUSB_SUCCESS)
 			res->done = true;
 }
 
@@ -835,7 +1006,7 @@ static LIBUSB_CALL void write_cb(struct libusb_transfer *transfer)
 
 	DEBUG_PRINT_BUF(transfer->buffer, transfer->actual_length);
 
-	if (res->transferred == ctx->write_count)
+	if (res->transferred == ctx->write_count || transfer->status == LIBUSB_TRANSFER_CANCELLED)
 		res->done = true;
 	else {
 		transfer->length = ctx->write_count - res->transferred;
@@ -856,6 +1027,13 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 		return retval;
 	}
 
+	/* Wait for the streamed buffers, errors are reported by this flush */
+	retval = stream_wait(ctx, NULL);
+	if (retval != ERROR_OK) {
+		mpsse_purge(ctx);
+		return retval;
+	}
+
 	LOG_DEBUG_IO("write %d%s, read %d", ctx->write_count, ctx->read_count ? "+1" : "",
 			ctx->read_count);
 	assert(ctx->write_count > 0 || ctx->read_count == 0); /* No read data without write data */
@@ -863,6 +1041,7 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 	if (ctx->write_count == 0)
 		return retval;
 
+	struct libusb_transfer *write_transfer = ctx->write_transfer;
 	struct libusb_transfer *read_transfer = NULL;
 	struct transfer_result read_result = { .ctx = ctx, .done = true };
 	if (ctx->read_count) {
@@ -873,7 +1052,6 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 	}
 
 	struct transfer_result write_result = { .ctx = ctx, .done = false };
-	struct libusb_transfer *write_transfer = libusb_alloc_transfer(0);
 	libusb_fill_bulk_transfer(write_transfer, ctx->usb_dev, ctx->out_ep, ctx->write_buffer,
 		ctx->write_count, write_cb, &write_result, ctx->usb_write_timeout);
 	retval = libusb_submit_transfer(write_transfer);
@@ -881,13 +1059,18 @@ int mpsse_flush(struct mpsse_ctx *ctx)
 		goto error_check;
 
 	if (ctx->read_count) {
-		read_transfer = libusb_alloc_transfer(0);
+		read_transfer = ctx->read_transfer;
 		libusb_fill_bulk_transfer(read_transfer, ctx->usb_dev, ctx->in_ep, ctx->read_chunk,
 			ctx->read_chunk_size, read_cb, &read_result,
 			ctx->usb_read_timeout);
 		retval = libusb_submit_transfer(read_transfer);
-		if (retval != LIBUSB_SUCCESS)
+		if (retval != LIBUSB_SUCCESS) {
+			/* The write transfer is reused, wait for its cancellation */
+			libusb_cancel_transfer(write_transfer);
+			while (!write_result.done)
+				libusb_handle_events_completed(ctx->usb_ctx, NULL);
 			goto error_check;
+		}
 	}
 
 	/* Polling loop, more or less taken from libftdi */
@@ -947,9 +1130,5 @@ error_check:
 	if (retval != ERROR_OK)
 		mpsse_purge(ctx);
 
-	libusb_free_transfer(write_transfer);
-	if (read_transfer)
-		libusb_free_transfer(read_transfer);
-
 	return retval;
 }
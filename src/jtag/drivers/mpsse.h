@@ -41,6 +41,10 @@ struct mpsse_ctx *mpsse_open(const uint16_t *vid, const uint16_t *pid, const cha
 void mpsse_close(struct mpsse_ctx *ctx);
 bool mpsse_is_high_speed(struct mpsse_ctx *ctx);
 
+/* Let the commands that need no read-back be sent without waiting for the USB transfers to
+ * complete while more commands are queued. mpsse_flush() always waits for all the transfers. */
+void mpsse_set_streaming(struct mpsse_ctx *ctx, bool enable);
+
 /* Command queuing. These correspond to the MPSSE commands with the same names, but no need to care
  * about bit/byte transfer or data length limitation. Read data is guaranteed to be available only
  * after the following mpsse_flush(). */
@@ -130,6 +130,8 @@ struct jtag_tap {
 
 	/** current instruction */
 	uint8_t *cur_instr;
+	/** cur_instr is known to match the content of the IR */
+	bool cur_instr_valid;
 	/** Bypass register selected */
 	bool bypass;
 
@@ -256,6 +258,15 @@ void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
 bool jtag_will_verify_capture_ir(void);
 
+/** Enable or disable skipping IR scans that reload the current instructions. */
+void jtag_set_ir_cache(bool enable);
+/** @returns True if IR scans reloading the current instructions are skipped. */
+bool jtag_will_cache_ir(void);
+/** @returns The number of IR scans skipped so far. */
+uint64_t jtag_get_ir_cache_skips(void);
+/** Forget the instructions loaded in the TAPs, the next IR scan is always shifted. */
+void jtag_ir_cache_invalidate(void);
+
 /** Set ms to sleep after jtag_execute_queue() flushes queue. Debug purposes. */
 void jtag_set_flush_queue_sleep(int ms);
 
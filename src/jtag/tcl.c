@@ -218,6 +218,71 @@ COMMAND_HANDLER(handle_jtag_flush_count)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_jtag_queue_arena)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_command_queue_set_arena(enable);
+	}
+
+	const char *status = jtag_command_queue_uses_arena() ? "enabled" : "disabled";
+	command_print(CMD, "JTAG queue arena is %s", status);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_queue_stats)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct cmd_queue_stats stats;
+	jtag_command_queue_get_stats(&stats);
+
+	command_print(CMD, "queue resets:       %" PRIu64, stats.resets);
+	command_print(CMD, "page allocations:   %" PRIu64, stats.page_allocs);
+	command_print(CMD, "page reuses:        %" PRIu64, stats.page_reuses);
+	command_print(CMD, "high-water pages:   %u", stats.pages_high_water);
+	command_print(CMD, "high-water bytes:   %zu", stats.bytes_high_water);
+	command_print(CMD, "retained pages:     %u (%zu bytes)",
+		stats.pages_retained, stats.bytes_retained);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_jtag_queue_optimize)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_command_queue_set_optimize(enable);
+	}
+
+	const char *status = jtag_command_queue_optimizes() ? "enabled" : "disabled";
+	command_print(CMD, "JTAG queue optimizer is %s", status);
+
+	struct cmd_queue_opt_stats stats;
+	jtag_command_queue_get_opt_stats(&stats);
+
+	command_print(CMD, "queues:             %" PRIu64, stats.queues);
+	command_print(CMD, "commands:           %" PRIu64 " -> %" PRIu64,
+		stats.commands_in, stats.commands_out);
+	command_print(CMD, "scan bits:          %" PRIu64 " -> %" PRIu64,
+		stats.scan_bits_in, stats.scan_bits_out);
+	command_print(CMD, "IR scans dropped:   %" PRIu64, stats.ir_scans_dropped);
+	command_print(CMD, "clocks folded:      %" PRIu64, stats.clocks_folded);
+	command_print(CMD, "fields merged:      %" PRIu64, stats.fields_merged);
+
+	return ERROR_OK;
+}
+
 /* REVISIT Just what about these should "move" ... ?
  * These registrations, into the main JTAG table?
  *
@@ -774,6 +839,31 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 		.help = "Returns list of all JTAG tap names.",
 		.usage = "",
 	},
+	{
+		.name = "queue_arena",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_arena,
+		.help = "Display or assign flag controlling whether the memory "
+			"of the JTAG command queue is recycled across flushes.",
+		.usage = "['enable'|'disable']",
+	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_stats,
+		.help = "Display allocation and reuse counters of the JTAG "
+			"command queue memory.",
+		.usage = "",
+	},
+	{
+		.name = "queue_optimize",
+		.mode = COMMAND_ANY,
+		.handler = handle_jtag_queue_optimize,
+		.help = "Display or assign flag controlling whether redundant "
+			"commands are removed from the JTAG queue before it is "
+			"flushed, and display the optimizer counters.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.chain = jtag_command_handlers_to_move,
 	},
@@ -985,6 +1075,9 @@ COMMAND_HANDLER(handle_irscan_command)
 		fields[i].in_value = NULL;
 	}
 
+	/* the user asked for this scan, shift it even if it looks redundant */
+	jtag_ir_cache_invalidate();
+
 	/* did we have an endstate? */
 	jtag_add_ir_scan(tap, fields, endstate);
 
@@ -1016,6 +1109,25 @@ COMMAND_HANDLER(handle_verify_ircapture_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_ir_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_ir_cache(enable);
+		jtag_ir_cache_invalidate();
+	}
+
+	const char *status = jtag_will_cache_ir() ? "enabled" : "disabled";
+	command_print(CMD, "IR cache is %s, %" PRIu64 " IR scans skipped",
+		status, jtag_get_ir_cache_skips());
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_verify_jtag_command)
 {
 	if (CMD_ARGC > 1)
@@ -1168,6 +1280,14 @@ static const struct command_registration jtag_command_handlers[] = {
 			"verify values captured during Capture-IR.",
 		.usage = "['enable'|'disable']",
 	},
+	{
+		.name = "ir_cache",
+		.handler = handle_ir_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or assign flag controlling whether IR scans "
+			"reloading the current instructions are skipped.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.name = "verify_jtag",
 		.handler = handle_verify_jtag_command,
@@ -101,6 +101,9 @@ struct gdb_connection {
 	enum gdb_output_flag output_flag;
 	/* Unique index for this GDB connection. */
 	unsigned int unique_index;
+	/* reusable buffer holding whole outgoing packets, see gdb_get_frame_buffer() */
+	char *frame_buffer;
+	size_t frame_buffer_size;
 };
 
 #if 0
@@ -401,18 +404,18 @@ static void gdb_log_outgoing_packet(struct connection *connection, char *packet_
 			gdb_connection->unique_index, packet_len, packet_buf, checksum);
 }
 
+/*
+ * When 'framed' is set, the payload in 'buffer' is preceded by the '$'
+ * character and followed by '#' and the two checksum digits, so that the
+ * whole packet is sent with a single write.
+ */
 static int gdb_put_packet_inner(struct connection *connection,
-		char *buffer, int len)
+		char *buffer, int len, unsigned char my_checksum, bool framed)
 {
-	int i;
-	unsigned char my_checksum = 0;
 	int reply;
 	int retval;
 	struct gdb_connection *gdb_con = connection->priv;
 
-	for (i = 0; i < len; i++)
-		my_checksum += buffer[i];
-
 #ifdef _DEBUG_GDB_IO_
 	/*
 	 * At this point we should have nothing in the input queue from GDB,
@@ -445,7 +448,11 @@ static int gdb_put_packet_inner(struct connection *connection,
 
 		char local_buffer[1024];
 		local_buffer[0] = '$';
-		if ((size_t)len + 4 <= sizeof(local_buffer)) {
+		if (framed) {
+			retval = gdb_write(connection, buffer - 1, len + 4);
+			if (retval != ERROR_OK)
+				return retval;
+		} else if ((size_t)len + 4 <= sizeof(local_buffer)) {
 			/* performance gain on smaller packets by only a single call to gdb_write() */
 			memcpy(local_buffer + 1, buffer, len++);
 			len += snprintf(local_buffer + len, sizeof(local_buffer) - len, "#%02x", my_checksum);
@@ -525,8 +532,51 @@ static int gdb_put_packet_inner(struct connection *connection,
 int gdb_put_packet(struct connection *connection, char *buffer, int len)
 {
 	struct gdb_connection *gdb_con = connection->priv;
+	unsigned char my_checksum = 0;
+
+	for (int i = 0; i < len; i++)
+		my_checksum += buffer[i];
+
+	gdb_con->busy = true;
+	int retval = gdb_put_packet_inner(connection, buffer, len, my_checksum, false);
+	gdb_con->busy = false;
+
+	/* we sent some data, reset timer for keep alive messages */
+	kept_alive();
+
+	return retval;
+}
+
+/**
+ * Return the per connection buffer used to build outgoing packet frames,
+ * grown to at least @a size bytes. The buffer is kept across packets.
+ */
+static char *gdb_get_frame_buffer(struct connection *connection, size_t size)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
+	if (gdb_con->frame_buffer_size < size) {
+		char *frame_buffer = realloc(gdb_con->frame_buffer, size);
+		if (!frame_buffer)
+			return NULL;
+		gdb_con->frame_buffer = frame_buffer;
+		gdb_con->frame_buffer_size = size;
+	}
+
+	return gdb_con->frame_buffer;
+}
+
+/**
+ * Send a packet already laid out in @a frame as '$' payload '#' checksum,
+ * where @a len is the length of the payload.
+ */
+static int gdb_put_packet_frame(struct connection *connection, char *frame, int len,
+		unsigned char checksum)
+{
+	struct gdb_connection *gdb_con = connection->priv;
+
 	gdb_con->busy = true;
-	int retval = gdb_put_packet_inner(connection, buffer, len);
+	int retval = gdb_put_packet_inner(connection, frame + 1, len, checksum, true);
 	gdb_con->busy = false;
 
 	/* we sent some data, reset timer for keep alive messages */
@@ -1004,6 +1054,8 @@ static int gdb_new_connection(struct connection *connection)
 	gdb_connection->thread_list = NULL;
 	gdb_connection->output_flag = GDB_OUTPUT_NO;
 	gdb_connection->unique_index = next_unique_id++;
+	gdb_connection->frame_buffer = NULL;
+	gdb_connection->frame_buffer_size = 0;
 
 	/* output goes through gdb connection */
 	command_set_output_handler(connection->cmd_ctx, gdb_output, connection);
@@ -1117,6 +1169,7 @@ static int gdb_connection_closed(struct connection *connection)
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, target);
 
+	free(gdb_connection->frame_buffer);
 	free(connection->priv);
 	connection->priv = NULL;
 
@@ -1124,6 +1177,9 @@ static int gdb_connection_closed(struct connection *connection)
 
 	target_call_event_callbacks(target, TARGET_EVENT_GDB_END);
 
+	if (target->state == TARGET_HALTED)
+		target_restore_working_area_snapshot(target);
+
 	target_call_event_callbacks(target, TARGET_EVENT_GDB_DETACH);
 
 	return ERROR_OK;
@@ -1504,7 +1560,6 @@ static int gdb_read_memory_packet(struct connection *connection,
 	uint32_t len = 0;
 
 	uint8_t *buffer;
-	char *hex_buffer;
 
 	int retval = ERROR_OK;
 
@@ -1526,7 +1581,15 @@ static int gdb_read_memory_packet(struct connection *connection,
 		return ERROR_OK;
 	}
 
-	buffer = malloc(len);
+	/* The reply frame is '$', 2 * len hex digits, '#' and two checksum
+	 * digits. The memory is read in the upper part of the frame and then
+	 * converted in place, avoiding any intermediate buffer. */
+	char *frame = gdb_get_frame_buffer(connection, 2 * (size_t)len + 5);
+	if (!frame) {
+		LOG_ERROR("Out of memory for read memory packet of %" PRIu32 " bytes", len);
+		return gdb_error(connection, ERROR_FAIL);
+	}
+	buffer = (uint8_t *)frame + 1 + len;
 
 	LOG_DEBUG("addr: 0x%16.16" PRIx64 ", len: 0x%8.8" PRIx32 "", addr, len);
 
@@ -1555,18 +1618,15 @@ static int gdb_read_memory_packet(struct connection *connection,
 	}
 
 	if (retval == ERROR_OK) {
-		hex_buffer = malloc(len * 2 + 1);
-
-		size_t pkt_len = hexify(hex_buffer, buffer, len, len * 2 + 1);
+		unsigned char checksum = hexify_sum(frame + 1, buffer, len);
 
-		gdb_put_packet(connection, hex_buffer, pkt_len);
+		frame[0] = '$';
+		snprintf(frame + 1 + 2 * len, 4, "#%02x", checksum);
 
-		free(hex_buffer);
+		gdb_put_packet_frame(connection, frame, 2 * len, checksum);
 	} else
 		retval = gdb_error(connection, retval);
 
-	free(buffer);
-
 	return retval;
 }
 
@@ -35,6 +35,10 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 static struct service *services;
 
 enum shutdown_reason {
@@ -54,6 +58,24 @@ static int polling_period = 100;
 /* address by name on which to listen for incoming TCP/IP connections */
 static char *bindto_name;
 
+/* set when a service or a connection is added or removed */
+static bool server_fds_changed = true;
+
+/* fds with pending input, filled by server_wait_input() when using select() */
+static fd_set read_fds;
+
+#ifdef HAVE_SYS_EPOLL_H
+#define SERVER_MAX_EPOLL_EVENTS	64
+
+/* epoll instance watching the service and connection fds, -1 to use select() */
+static int epoll_fd = -1;
+static int *epoll_watched_fds;
+static unsigned int epoll_num_watched;
+static unsigned int epoll_max_watched;
+static struct epoll_event epoll_events[SERVER_MAX_EPOLL_EVENTS];
+static int epoll_num_events;
+#endif
+
 static int add_connection(struct service *service, struct command_context *cmd_ctx)
 {
 	socklen_t address_size;
@@ -146,6 +168,7 @@ static int add_connection(struct service *service, struct command_context *cmd_c
 	for (p = &service->connections; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_fds_changed = true;
 
 	if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 		service->max_connections--;
@@ -174,6 +197,7 @@ static int remove_connection(struct service *service, struct connection *connect
 			/* delete connection */
 			*p = c->next;
 			free(c);
+			server_fds_changed = true;
 
 			if (service->max_connections != CONNECTION_LIMIT_UNLIMITED)
 				service->max_connections++;
@@ -333,6 +357,7 @@ int add_service(const struct service_driver *driver, const char *port,
 	for (p = &services; *p; p = &(*p)->next)
 		;
 	*p = c;
+	server_fds_changed = true;
 
 	return ERROR_OK;
 }
@@ -373,6 +398,7 @@ int remove_service(const char *name, const char *port)
 
 			free(tmp->priv);
 			free_service(tmp);
+			server_fds_changed = true;
 
 			return ERROR_OK;
 		}
@@ -407,6 +433,7 @@ static int remove_services(void)
 	}
 
 	services = NULL;
+	server_fds_changed = true;
 
 	return ERROR_OK;
 }
@@ -419,16 +446,164 @@ void server_keep_clients_alive(void)
 				s->keep_client_alive(c);
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static int epoll_watch_fd(int fd)
+{
+	struct epoll_event event = {
+		.events = EPOLLIN,
+		.data.fd = fd,
+	};
+
+	if (epoll_num_watched == epoll_max_watched) {
+		unsigned int max = epoll_max_watched ? 2 * epoll_max_watched : 16;
+		int *fds = realloc(epoll_watched_fds, max * sizeof(*fds));
+		if (!fds)
+			return ERROR_FAIL;
+		epoll_watched_fds = fds;
+		epoll_max_watched = max;
+	}
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1 && errno != EEXIST) {
+		/* e.g. stdin redirected from a regular file */
+		LOG_DEBUG("cannot watch fd %d with epoll: %s", fd, strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	epoll_watched_fds[epoll_num_watched++] = fd;
+
+	return ERROR_OK;
+}
+
+/* Update the epoll set after services or connections were added or removed */
+static int epoll_sync_fds(void)
+{
+	/* fds closed since the last update already left the set, ignore errors */
+	for (unsigned int i = 0; i < epoll_num_watched; i++)
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, epoll_watched_fds[i], NULL);
+	epoll_num_watched = 0;
+
+	for (struct service *service = services; service; service = service->next) {
+		if (service->fd != -1 && epoll_watch_fd(service->fd) != ERROR_OK)
+			return ERROR_FAIL;
+
+		for (struct connection *c = service->connections; c; c = c->next)
+			if (c->fd >= 0 && epoll_watch_fd(c->fd) != ERROR_OK)
+				return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+static void epoll_release(void)
+{
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	epoll_fd = -1;
+
+	free(epoll_watched_fds);
+	epoll_watched_fds = NULL;
+	epoll_num_watched = 0;
+	epoll_max_watched = 0;
+	epoll_num_events = 0;
+}
+#endif
+
+/*
+ * Wait up to timeout_ms for input on the services and connections.
+ * Returns the number of fds with input, 0 on timeout or -1 on error.
+ */
+static int server_wait_input(int timeout_ms)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll_fd != -1 && server_fds_changed) {
+		server_fds_changed = false;
+		if (epoll_sync_fds() != ERROR_OK) {
+			LOG_DEBUG("falling back to select()");
+			epoll_release();
+		}
+	}
+
+	if (epoll_fd != -1) {
+		epoll_num_events = epoll_wait(epoll_fd, epoll_events,
+				SERVER_MAX_EPOLL_EVENTS, timeout_ms);
+		if (epoll_num_events == -1) {
+			int retval = errno == EINTR ? 0 : -1;
+			epoll_num_events = 0;
+			return retval;
+		}
+		return epoll_num_events;
+	}
+#endif
+
+	int fd_max = 0;
+	FD_ZERO(&read_fds);
+
+	/* add service and connection fds to read_fds */
+	for (struct service *service = services; service; service = service->next) {
+		if (service->fd != -1) {
+			/* listen for new connections */
+			FD_SET(service->fd, &read_fds);
+
+			if (service->fd > fd_max)
+				fd_max = service->fd;
+		}
+
+		for (struct connection *c = service->connections; c; c = c->next) {
+			/* check for activity on the connection */
+			FD_SET(c->fd, &read_fds);
+			if (c->fd > fd_max)
+				fd_max = c->fd;
+		}
+	}
+
+	struct timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = timeout_ms * 1000;
+
+	int retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
+
+	if (retval == -1) {
+#ifdef _WIN32
+		errno = WSAGetLastError();
+
+		if (errno == WSAEINTR) {
+#else
+		if (errno == EINTR) {
+#endif
+			FD_ZERO(&read_fds);
+			return 0;
+		}
+	} else if (retval == 0) {
+		FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
+	}
+
+	return retval;
+}
+
+/* Check if the last server_wait_input() reported input on fd */
+static bool server_fd_has_input(int fd)
+{
+	if (fd < 0)
+		return false;
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (epoll_fd != -1) {
+		for (int i = 0; i < epoll_num_events; i++)
+			if (epoll_events[i].data.fd == fd)
+				return true;
+		return false;
+	}
+#endif
+
+	return FD_ISSET(fd, &read_fds);
+}
+
 int server_loop(struct command_context *command_context)
 {
 	struct service *service;
 
 	bool poll_ok = true;
 
-	/* used in select() */
-	fd_set read_fds;
-	int fd_max;
-
 	/* used in accept() */
 	int retval;
 
@@ -439,86 +614,53 @@ int server_loop(struct command_context *command_context)
 		LOG_ERROR("couldn't set SIGPIPE to SIG_IGN");
 #endif
 
-	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
-		/* monitor sockets for activity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next) {
-			if (service->fd != -1) {
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
-
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-
-			if (service->connections) {
-				struct connection *c;
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1)
+		LOG_DEBUG("epoll not available, using select(): %s", strerror(errno));
+	server_fds_changed = true;
+#endif
 
-				for (c = service->connections; c; c = c->next) {
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
+	while (shutdown_openocd == CONTINUE_MAIN_LOOP) {
+		int timeout_ms = 0;
 
-		struct timeval tv;
-		tv.tv_sec = 0;
-		if (poll_ok) {
-			/* we're just polling this iteration, this is faster on embedded
-			 * hosts */
-			tv.tv_usec = 0;
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		} else {
-			/* Timeout socket_select() when a target timer expires or every polling_period */
-			int timeout_ms = next_event - timeval_ms();
+		/* we're just polling this iteration if there was something to do
+		 * last time, this is faster on embedded hosts */
+		if (!poll_ok) {
+			/* Timeout when a target timer expires or every polling_period */
+			timeout_ms = next_event - timeval_ms();
 			if (timeout_ms < 0)
 				timeout_ms = 0;
 			else if (timeout_ms > polling_period)
 				timeout_ms = polling_period;
-			tv.tv_usec = timeout_ms * 1000;
-			/* Only while we're sleeping we'll let others run */
-			retval = socket_select(fd_max + 1, &read_fds, NULL, NULL, &tv);
 		}
 
-		if (retval == -1) {
-#ifdef _WIN32
-
-			errno = WSAGetLastError();
-
-			if (errno == WSAEINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
-			}
-#else
+		/* monitor sockets for activity, only while we're sleeping we'll let
+		 * others run */
+		retval = server_wait_input(timeout_ms);
 
-			if (errno == EINTR)
-				FD_ZERO(&read_fds);
-			else {
-				LOG_ERROR("error during select: %s", strerror(errno));
-				return ERROR_FAIL;
-			}
+		if (retval == -1) {
+			LOG_ERROR("error while waiting for input: %s", strerror(errno));
+#ifdef HAVE_SYS_EPOLL_H
+			epoll_release();
 #endif
+			return ERROR_FAIL;
 		}
 
-		if (retval == 0) {
+		if (retval == 0 || timeval_ms() >= next_event) {
 			/* Execute callbacks of expired timers when
 			 * - there was nothing to do if poll_ok was true
-			 * - socket_select() timed out if poll_ok was false, now one or more
+			 * - the wait timed out if poll_ok was false, now one or more
 			 *   timers expired or the polling period elapsed
+			 * - a timer is due while busy with the connections, so that it
+			 *   is not delayed by a continuous flow of input
 			 */
 			target_call_timer_callbacks();
 			next_event = target_timer_next_event();
 			process_jim_events(command_context);
+		}
 
-			FD_ZERO(&read_fds);	/* eCos leaves read_fds unchanged in this case!  */
-
+		if (retval == 0) {
 			/* We timed out/there was nothing to do, timeout rather than poll next time
 			 **/
 			poll_ok = false;
@@ -537,7 +679,7 @@ int server_loop(struct command_context *command_context)
 		for (service = services; service; service = service->next) {
 			/* handle new connections on listeners */
 			if ((service->fd != -1)
-				&& (FD_ISSET(service->fd, &read_fds))) {
+				&& server_fd_has_input(service->fd)) {
 				if (service->max_connections != 0)
 					add_connection(service, command_context);
 				else {
@@ -561,7 +703,7 @@ int server_loop(struct command_context *command_context)
 				struct connection *c;
 
 				for (c = service->connections; c; ) {
-					if ((c->fd >= 0 && FD_ISSET(c->fd, &read_fds)) || c->input_pending) {
+					if (server_fd_has_input(c->fd) || c->input_pending) {
 						retval = service->input(c);
 						if (retval != ERROR_OK) {
 							struct connection *next = c->next;
@@ -592,6 +734,10 @@ int server_loop(struct command_context *command_context)
 #endif
 	}
 
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_release();
+#endif
+
 	/* when quit for signal or CTRL-C, run (eventually user implemented) "shutdown" */
 	if (shutdown_openocd == SHUTDOWN_WITH_SIGNAL_CODE)
 		command_run_line(command_context, "shutdown");
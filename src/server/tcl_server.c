@@ -16,6 +16,11 @@
 #define TCL_SERVER_VERSION		"TCL Server 0.1"
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
+/* Default thresholds of the trace data coalesced in binary mode */
+#define TCL_TRACE_DEFAULT_SIZE		(64*1024)
+#define TCL_TRACE_DEFAULT_DELAY_MS	20
+/* Size of the target memory accesses of the binary transfers */
+#define TCL_BINARY_CHUNK_SIZE		(256*1024)
 
 struct tcl_connection {
 	int tc_linedrop;
@@ -26,6 +31,21 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	/* trace data sent in binary frames, coalesced up to a size or a delay */
+	bool tc_trace_binary;
+	uint32_t tc_trace_max_size;
+	unsigned int tc_trace_delay_ms;
+	/* pending binary trace data, or hex encoded trace message */
+	uint8_t *tc_trace_buf;
+	size_t tc_trace_buf_size;
+	size_t tc_trace_len;
+	/* raw data of 'tcl write_binary' being received */
+	struct target *tc_bin_target;
+	target_addr_t tc_bin_address;
+	uint32_t tc_bin_remaining;
+	uint32_t tc_bin_len;
+	uint8_t *tc_bin_buf;
+	int tc_bin_retval;
 };
 
 static char *tcl_port;
@@ -78,29 +98,136 @@ static int tcl_target_callback_reset_handler(struct target *target,
 	return ERROR_OK;
 }
 
+static int tcl_trace_buf_reserve(struct tcl_connection *tclc, size_t size)
+{
+	if (tclc->tc_trace_buf_size >= size)
+		return ERROR_OK;
+
+	uint8_t *buf = realloc(tclc->tc_trace_buf, size);
+	if (!buf) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	tclc->tc_trace_buf = buf;
+	tclc->tc_trace_buf_size = size;
+
+	return ERROR_OK;
+}
+
+/* send trace data as a header giving its length followed by the raw bytes */
+static int tcl_trace_output_binary(struct connection *connection,
+		const uint8_t *data, size_t len)
+{
+	char header[64];
+
+	snprintf(header, sizeof(header), "type target_trace_binary length %zu\r\n\x1a", len);
+	int retval = tcl_output(connection, header, strlen(header));
+	if (retval != ERROR_OK)
+		return retval;
+
+	return tcl_output(connection, data, len);
+}
+
+static int tcl_trace_flush(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	if (!tclc->tc_trace_len)
+		return ERROR_OK;
+
+	int retval = tcl_trace_output_binary(connection, tclc->tc_trace_buf, tclc->tc_trace_len);
+	tclc->tc_trace_len = 0;
+
+	return retval;
+}
+
+static int tcl_trace_timer_callback(void *priv)
+{
+	tcl_trace_flush(priv);
+
+	return ERROR_OK;
+}
+
+static void tcl_trace_stop_binary(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	if (!tclc->tc_trace_binary)
+		return;
+
+	tcl_trace_flush(connection);
+	target_unregister_timer_callback(tcl_trace_timer_callback, connection);
+	tclc->tc_trace_binary = false;
+}
+
+static int tcl_trace_start_binary(struct connection *connection,
+		uint32_t max_size, unsigned int delay_ms)
+{
+	struct tcl_connection *tclc = connection->priv;
+
+	tcl_trace_stop_binary(connection);
+
+	int retval = tcl_trace_buf_reserve(tclc, max_size);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_register_timer_callback(tcl_trace_timer_callback, delay_ms,
+			TARGET_TIMER_TYPE_PERIODIC, connection);
+	if (retval != ERROR_OK)
+		return retval;
+
+	tclc->tc_trace_max_size = max_size;
+	tclc->tc_trace_delay_ms = delay_ms;
+	tclc->tc_trace_binary = true;
+	tclc->tc_trace = true;
+
+	return ERROR_OK;
+}
+
 static int tcl_target_callback_trace_handler(struct target *target,
 		size_t len, uint8_t *data, void *priv)
 {
 	struct connection *connection = priv;
 	struct tcl_connection *tclc;
-	char *header = "type target_trace data ";
-	char *trailer = "\r\n\x1a";
-	size_t hex_len = len * 2 + 1;
-	size_t max_len = hex_len + strlen(header) + strlen(trailer);
-	char *buf, *hex;
+	const char *header = "type target_trace data ";
+	const char *trailer = "\r\n\x1a";
+	size_t header_len = strlen(header);
+	size_t trailer_len = strlen(trailer);
 
 	tclc = connection->priv;
 
-	if (tclc->tc_trace) {
-		hex = malloc(hex_len);
-		buf = malloc(max_len);
-		hexify(hex, data, len, hex_len);
-		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
-		free(hex);
-		free(buf);
+	if (!tclc->tc_trace)
+		return ERROR_OK;
+
+	if (tclc->tc_trace_binary) {
+		if (tclc->tc_trace_len + len > tclc->tc_trace_max_size)
+			tcl_trace_flush(connection);
+
+		/* large chunks are sent as is, without copy */
+		if (len >= tclc->tc_trace_max_size) {
+			tcl_trace_output_binary(connection, data, len);
+			return ERROR_OK;
+		}
+
+		memcpy(tclc->tc_trace_buf + tclc->tc_trace_len, data, len);
+		tclc->tc_trace_len += len;
+		if (tclc->tc_trace_len == tclc->tc_trace_max_size)
+			tcl_trace_flush(connection);
+
+		return ERROR_OK;
 	}
 
+	size_t max_len = header_len + len * 2 + trailer_len + 1;
+	if (tcl_trace_buf_reserve(tclc, max_len) != ERROR_OK)
+		return ERROR_OK;
+
+	char *buf = (char *)tclc->tc_trace_buf;
+	memcpy(buf, header, header_len);
+	size_t hex_len = hexify(buf + header_len, data, len, len * 2 + 1);
+	memcpy(buf + header_len + hex_len, trailer, trailer_len);
+	tcl_output(connection, buf, header_len + hex_len + trailer_len);
+
 	return ERROR_OK;
 }
 
@@ -128,6 +255,65 @@ int tcl_output(struct connection *connection, const void *data, ssize_t len)
 	return ERROR_SERVER_REMOTE_CLOSED;
 }
 
+/* account for received raw data, write it to the target by chunks */
+static int tcl_binary_received(struct connection *connection, uint32_t len)
+{
+	struct tcl_connection *tclc = connection->priv;
+	uint32_t chunk_size = MIN(tclc->tc_bin_remaining, TCL_BINARY_CHUNK_SIZE);
+
+	tclc->tc_bin_len += len;
+	tclc->tc_bin_remaining -= len;
+
+	if (tclc->tc_bin_len < chunk_size && tclc->tc_bin_remaining)
+		return ERROR_OK;
+
+	/* the data is still received after an error, to remain in sync with the client */
+	if (tclc->tc_bin_retval == ERROR_OK) {
+		tclc->tc_bin_retval = target_write_buffer(tclc->tc_bin_target,
+				tclc->tc_bin_address, tclc->tc_bin_len, tclc->tc_bin_buf);
+		if (tclc->tc_bin_retval != ERROR_OK)
+			LOG_ERROR("failed to write memory at " TARGET_ADDR_FMT, tclc->tc_bin_address);
+	}
+	tclc->tc_bin_address += tclc->tc_bin_len;
+	tclc->tc_bin_len = 0;
+
+	if (tclc->tc_bin_remaining)
+		return ERROR_OK;
+
+	/* transfer complete, send the deferred result of the command */
+	free(tclc->tc_bin_buf);
+	tclc->tc_bin_buf = NULL;
+
+	if (tclc->tc_bin_retval != ERROR_OK) {
+		char buf[80];
+
+		snprintf(buf, sizeof(buf), "failed to write memory at " TARGET_ADDR_FMT,
+				tclc->tc_bin_address);
+		int retval = tcl_output(connection, buf, strlen(buf));
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return tcl_output(connection, "\x1a", 1);
+}
+
+/* receive raw data straight in the buffer of the binary transfer */
+static int tcl_binary_input(struct connection *connection)
+{
+	struct tcl_connection *tclc = connection->priv;
+	uint32_t chunk_size = MIN(tclc->tc_bin_remaining, TCL_BINARY_CHUNK_SIZE);
+
+	ssize_t rlen = connection_read(connection, tclc->tc_bin_buf + tclc->tc_bin_len,
+			chunk_size - tclc->tc_bin_len);
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	return tcl_binary_received(connection, rlen);
+}
+
 /* connections */
 static int tcl_new_connection(struct connection *connection)
 {
@@ -173,6 +359,13 @@ static int tcl_input(struct connection *connection)
 	char *tc_line_new;
 	int tc_line_size_new;
 
+	tclc = connection->priv;
+	if (!tclc)
+		return ERROR_CONNECTION_REJECTED;
+
+	if (tclc->tc_bin_remaining)
+		return tcl_binary_input(connection);
+
 	rlen = connection_read(connection, &in, sizeof(in));
 	if (rlen <= 0) {
 		if (rlen < 0)
@@ -180,12 +373,21 @@ static int tcl_input(struct connection *connection)
 		return ERROR_SERVER_REMOTE_CLOSED;
 	}
 
-	tclc = connection->priv;
-	if (!tclc)
-		return ERROR_CONNECTION_REJECTED;
-
 	/* push as much data into the line as possible */
 	for (i = 0; i < rlen; i++) {
+		/* raw data following 'tcl write_binary' */
+		if (tclc->tc_bin_remaining) {
+			uint32_t chunk_size = MIN(tclc->tc_bin_remaining, TCL_BINARY_CHUNK_SIZE);
+			uint32_t count = MIN(rlen - i, chunk_size - tclc->tc_bin_len);
+
+			memcpy(tclc->tc_bin_buf + tclc->tc_bin_len, &in[i], count);
+			retval = tcl_binary_received(connection, count);
+			if (retval != ERROR_OK)
+				return retval;
+			i += count - 1;
+			continue;
+		}
+
 		/* buffer the data */
 		tclc->tc_line[tclc->tc_lineoffset] = in[i];
 		if (tclc->tc_lineoffset + 1 < tclc->tc_line_size) {
@@ -231,6 +433,14 @@ static int tcl_input(struct connection *connection)
 		} else {
 			tclc->tc_line[tclc->tc_lineoffset-1] = '\0';
 			command_run_line(connection->cmd_ctx, tclc->tc_line);
+
+			/* the result is sent once the raw data has been received */
+			if (tclc->tc_bin_remaining) {
+				tclc->tc_lineoffset = 0;
+				tclc->tc_linedrop = 0;
+				continue;
+			}
+
 			result = Jim_GetString(Jim_GetResult(interp), &reslen);
 			retval = tcl_output(connection, result, reslen);
 			if (retval != ERROR_OK)
@@ -253,6 +463,11 @@ static int tcl_closed(struct connection *connection)
 
 	/* cleanup connection context */
 	if (tclc) {
+		/* the timer may still be registered even if trace is stopped */
+		while (target_unregister_timer_callback(tcl_trace_timer_callback, connection) == ERROR_OK)
+			;
+		free(tclc->tc_trace_buf);
+		free(tclc->tc_bin_buf);
 		free(tclc->tc_line);
 		free(tclc);
 		connection->priv = NULL;
@@ -316,13 +531,139 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 
 	if (connection && !strcmp(connection->service->name, "tcl")) {
 		tclc = connection->priv;
-		return CALL_COMMAND_HANDLER(handle_command_parse_bool, &tclc->tc_trace, "Target trace output ");
+
+		if (CMD_ARGC > 0 && !strcmp(CMD_ARGV[0], "binary")) {
+			uint32_t max_size = TCL_TRACE_DEFAULT_SIZE;
+			unsigned int delay_ms = TCL_TRACE_DEFAULT_DELAY_MS;
+
+			if (CMD_ARGC > 3)
+				return ERROR_COMMAND_SYNTAX_ERROR;
+			if (CMD_ARGC > 1)
+				COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], max_size);
+			if (CMD_ARGC > 2)
+				COMMAND_PARSE_NUMBER(uint, CMD_ARGV[2], delay_ms);
+			if (max_size == 0 || delay_ms == 0) {
+				command_print(CMD, "size and delay must be at least 1");
+				return ERROR_COMMAND_ARGUMENT_INVALID;
+			}
+
+			int retval = tcl_trace_start_binary(connection, max_size, delay_ms);
+			if (retval != ERROR_OK)
+				return retval;
+		} else if (CMD_ARGC > 0) {
+			/* back to hex encoded messages, or disabled */
+			tcl_trace_stop_binary(connection);
+			return CALL_COMMAND_HANDLER(handle_command_parse_bool, &tclc->tc_trace, "Target trace output ");
+		} else if (!tclc->tc_trace_binary) {
+			return CALL_COMMAND_HANDLER(handle_command_parse_bool, &tclc->tc_trace, "Target trace output ");
+		}
+
+		LOG_INFO("Target trace output is binary, up to %" PRIu32 " bytes or %u ms per frame",
+				tclc->tc_trace_max_size, tclc->tc_trace_delay_ms);
+		return ERROR_OK;
 	} else {
 		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
 }
 
+COMMAND_HANDLER(handle_tcl_read_binary_command)
+{
+	struct connection *connection = CMD_CTX->output_handler_priv;
+	struct target *target = get_current_target(CMD_CTX);
+	target_addr_t address;
+	uint32_t size;
+
+	if (!connection || strcmp(connection->service->name, "tcl")) {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	uint8_t *buffer = malloc(MIN(size, TCL_BINARY_CHUNK_SIZE));
+	if (!buffer) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* each chunk is sent as a header with its length followed by the raw bytes */
+	int retval = ERROR_OK;
+	while (size > 0) {
+		uint32_t count = MIN(size, TCL_BINARY_CHUNK_SIZE);
+		char header[64];
+
+		retval = target_read_buffer(target, address, count, buffer);
+		if (retval != ERROR_OK) {
+			command_print(CMD, "failed to read memory at " TARGET_ADDR_FMT, address);
+			break;
+		}
+
+		snprintf(header, sizeof(header), "type memory_data length %" PRIu32 "\r\n\x1a", count);
+		retval = tcl_output(connection, header, strlen(header));
+		if (retval == ERROR_OK)
+			retval = tcl_output(connection, buffer, count);
+		if (retval != ERROR_OK)
+			break;
+
+		address += count;
+		size -= count;
+		keep_alive();
+	}
+
+	free(buffer);
+
+	return retval;
+}
+
+COMMAND_HANDLER(handle_tcl_write_binary_command)
+{
+	struct connection *connection = CMD_CTX->output_handler_priv;
+	struct target *target = get_current_target(CMD_CTX);
+	struct tcl_connection *tclc;
+	target_addr_t address;
+	uint32_t size;
+
+	if (!connection || strcmp(connection->service->name, "tcl")) {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	tclc = connection->priv;
+	if (tclc->tc_bin_remaining) {
+		command_print(CMD, "a binary transfer is already pending");
+		return ERROR_FAIL;
+	}
+
+	if (size == 0)
+		return ERROR_OK;
+
+	tclc->tc_bin_buf = malloc(MIN(size, TCL_BINARY_CHUNK_SIZE));
+	if (!tclc->tc_bin_buf) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* the next 'size' bytes received on the connection are the data */
+	tclc->tc_bin_target = target;
+	tclc->tc_bin_address = address;
+	tclc->tc_bin_remaining = size;
+	tclc->tc_bin_len = 0;
+	tclc->tc_bin_retval = ERROR_OK;
+
+	return ERROR_OK;
+}
+
 static const struct command_registration tcl_subcommand_handlers[] = {
 	{
 		.name = "port",
@@ -344,8 +685,22 @@ static const struct command_registration tcl_subcommand_handlers[] = {
 		.name = "trace",
 		.handler = handle_tcl_trace_command,
 		.mode = COMMAND_EXEC,
-		.help = "Target trace output",
-		.usage = "[on|off]",
+		.help = "Target trace output, hex encoded or in coalesced binary frames",
+		.usage = "[on|off|binary [max_size [delay_ms]]]",
+	},
+	{
+		.name = "read_binary",
+		.handler = handle_tcl_read_binary_command,
+		.mode = COMMAND_EXEC,
+		.help = "send target memory as raw bytes to the current Tcl RPC connection",
+		.usage = "address size",
+	},
+	{
+		.name = "write_binary",
+		.handler = handle_tcl_write_binary_command,
+		.mode = COMMAND_EXEC,
+		.help = "write to target memory the raw bytes which follow the command",
+		.usage = "address size",
 	},
 	COMMAND_REGISTRATION_DONE
 };
@@ -2598,7 +2598,7 @@ static int aarch64_examine_first(struct target *target)
 	int retval = ERROR_OK;
 	uint64_t debug, ttypr;
 	uint32_t cpuid;
-	uint32_t tmp0, tmp1, tmp2, tmp3;
+	uint32_t tmp0, tmp1, tmp2, tmp3, devid;
 	debug = ttypr = cpuid = 0;
 
 	if (!pc)
@@ -2671,12 +2671,21 @@ static int aarch64_examine_first(struct target *target)
 		return retval;
 	}
 
+	retval = mem_ap_read_u32(armv8->debug_ap,
+			armv8->debug_base + CPUDBG_EDDEVID, &devid);
+	if (retval != ERROR_OK) {
+		LOG_DEBUG("Examine %s failed", "EDDEVID");
+		return retval;
+	}
+
 	retval = dap_run(armv8->debug_ap->dap);
 	if (retval != ERROR_OK) {
 		LOG_ERROR("%s: examination failed\n", target_name(target));
 		return retval;
 	}
 
+	aarch64->pcsr_implemented = (devid & 0xf) != 0;
+
 	ttypr |= tmp1;
 	ttypr = (ttypr << 32) | tmp0;
 	debug |= tmp3;
@@ -3208,6 +3217,30 @@ static const struct command_registration aarch64_command_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
+static int aarch64_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples)
+{
+	struct aarch64_common *aarch64 = target_to_aarch64(target);
+	struct armv8_common *armv8 = &aarch64->armv8_common;
+
+	if (!aarch64->pcsr_implemented)
+		return ERROR_NOT_IMPLEMENTED;
+
+	/* Only the low 32 bits of the PC are sampled. A sample reads as
+	 * 0xffffffff while the core is halted or sampling is prohibited. */
+	int retval = mem_ap_read_buf_noincr(armv8->debug_ap, (uint8_t *)samples, 4,
+			max_num_samples, armv8->debug_base + CPUV8_DBG_EDPCSRLO);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (uint32_t i = 0; i < max_num_samples; i++)
+		samples[i] = le_to_h_u32((uint8_t *)&samples[i]);
+
+	*num_samples = max_num_samples;
+
+	return ERROR_OK;
+}
+
 struct target_type aarch64_target = {
 	.name = "aarch64",
 
@@ -3247,6 +3280,7 @@ struct target_type aarch64_target = {
 	.write_phys_memory = aarch64_write_phys_memory,
 	.mmu = aarch64_mmu,
 	.virt2phys = aarch64_virt2phys,
+	.sample_pc = aarch64_sample_pc,
 };
 
 struct target_type armv8r_target = {
@@ -3283,4 +3317,5 @@ struct target_type armv8r_target = {
 	.init_target = aarch64_init_target,
 	.deinit_target = aarch64_deinit_target,
 	.examine = aarch64_examine,
+	.sample_pc = aarch64_sample_pc,
 };
@@ -16,6 +16,7 @@
 #define CPUDBG_TTYPR	0xD0C
 #define ID_AA64PFR0_EL1	0xD20
 #define ID_AA64DFR0_EL1	0xD28
+#define CPUDBG_EDDEVID	0xFC8
 #define CPUDBG_LOCKACCESS 0xFB0
 #define CPUDBG_LOCKSTATUS 0xFB4
 
@@ -58,6 +59,9 @@ struct aarch64_common {
 	struct aarch64_brp *wp_list;
 
 	enum aarch64_isrmasking_mode isrmasking_mode;
+
+	/* EDPCSR is implemented, see EDDEVID.PCSample */
+	bool pcsr_implemented;
 };
 
 static inline struct aarch64_common *
@@ -30,6 +30,7 @@
 #include <helper/jim-nvp.h>
 #include <helper/list.h>
 #include <helper/log.h>
+#include <helper/time_support.h>
 #include <helper/types.h>
 #include <jtag/interface.h>
 #include <server/server.h>
@@ -65,6 +66,8 @@
 #define TPIU_DEVID_SUPPORT_MANCHESTER   BIT(10)
 #define TPIU_DEVID_SUPPORT_UART         BIT(11)
 
+#define ITM_NUM_STIMULUS_PORTS          32
+
 enum arm_tpiu_swo_event {
 	TPIU_SWO_EVENT_PRE_ENABLE,
 	TPIU_SWO_EVENT_POST_ENABLE,
@@ -79,6 +82,34 @@ static const struct jim_nvp nvp_arm_tpiu_swo_event[] = {
 	{ .value = TPIU_SWO_EVENT_POST_DISABLE, .name = "post-disable" },
 };
 
+enum itm_decoder_state {
+	ITM_STATE_HEADER,
+	ITM_STATE_SOURCE_PAYLOAD,
+	ITM_STATE_PROTOCOL_PAYLOAD,
+};
+
+/* Decoder of the ITM/DWT packets found in the trace stream, see ARM DDI 0403E D4.2 */
+struct itm_decoder {
+	enum itm_decoder_state state;
+	/* source packet being received */
+	bool hardware;
+	unsigned int port;
+	unsigned int size;
+	unsigned int count;
+	uint8_t payload[4];
+};
+
+struct arm_tpiu_swo_stats {
+	uint64_t bytes;
+	uint64_t polls;
+	/* polls that filled the whole buffer, the adapter may have dropped data */
+	uint64_t full_polls;
+	uint64_t write_errors;
+	uint64_t itm_overflows;
+	uint64_t itm_hw_packets;
+	uint64_t itm_port_bytes[ITM_NUM_STIMULUS_PORTS];
+};
+
 struct arm_tpiu_swo_event_action {
 	enum arm_tpiu_swo_event event;
 	Jim_Interp *interp;
@@ -112,6 +143,16 @@ struct arm_tpiu_swo_object {
 	char *out_filename;
 	/** track TCP connections */
 	struct list_head connections;
+	/** buffer receiving the trace data from the adapter */
+	uint8_t *trace_buf;
+	/** last time the output file was flushed */
+	int64_t last_flush_ms;
+	/** decode the ITM packets into one stream per stimulus port */
+	bool itm_decode;
+	struct itm_decoder itm;
+	/** destination of the decoded stimulus ports */
+	FILE *itm_file[ITM_NUM_STIMULUS_PORTS];
+	struct arm_tpiu_swo_stats stats;
 	/* START_DEPRECATED_TPIU */
 	bool recheck_ap_cur_target;
 	/* END_DEPRECATED_TPIU */
@@ -128,38 +169,138 @@ struct arm_tpiu_swo_priv_connection {
 
 static LIST_HEAD(all_tpiu_swo);
 
-#define ARM_TPIU_SWO_TRACE_BUF_SIZE	4096
+#define ARM_TPIU_SWO_TRACE_BUF_SIZE	(64 * 1024)
+/* Maximum number of adapter reads per timer tick, while the buffer gets filled */
+#define ARM_TPIU_SWO_MAX_POLLS		16
+/* Time between two flushes of the output file */
+#define ARM_TPIU_SWO_FLUSH_INTERVAL_MS	100
+
+static void itm_decoder_emit(struct arm_tpiu_swo_object *obj)
+{
+	struct itm_decoder *itm = &obj->itm;
+
+	if (itm->hardware) {
+		obj->stats.itm_hw_packets++;
+		return;
+	}
+
+	obj->stats.itm_port_bytes[itm->port] += itm->size;
+
+	FILE *f = obj->itm_file[itm->port];
+	if (f && fwrite(itm->payload, 1, itm->size, f) != itm->size)
+		obj->stats.write_errors++;
+}
+
+static void itm_decode(struct arm_tpiu_swo_object *obj, const uint8_t *buf, size_t size)
+{
+	struct itm_decoder *itm = &obj->itm;
+
+	for (size_t i = 0; i < size; i++) {
+		uint8_t byte = buf[i];
+
+		switch (itm->state) {
+		case ITM_STATE_HEADER:
+			if (byte == 0x00 || byte == 0x80) {
+				/* synchronization packet */
+			} else if (byte == 0x70) {
+				obj->stats.itm_overflows++;
+			} else if (byte & 0x03) {
+				itm->hardware = byte & 0x04;
+				itm->port = byte >> 3;
+				itm->size = (byte & 0x03) == 3 ? 4 : (byte & 0x03);
+				itm->count = 0;
+				itm->state = ITM_STATE_SOURCE_PAYLOAD;
+			} else if (byte & 0x80) {
+				/* timestamp or extension packet with payload */
+				itm->state = ITM_STATE_PROTOCOL_PAYLOAD;
+			}
+			break;
+		case ITM_STATE_SOURCE_PAYLOAD:
+			itm->payload[itm->count++] = byte;
+			if (itm->count == itm->size) {
+				itm_decoder_emit(obj);
+				itm->state = ITM_STATE_HEADER;
+			}
+			break;
+		case ITM_STATE_PROTOCOL_PAYLOAD:
+			/* the last byte of the payload has no continuation bit */
+			if (!(byte & 0x80))
+				itm->state = ITM_STATE_HEADER;
+			break;
+		}
+	}
+}
 
 static int arm_tpiu_swo_poll_trace(void *priv)
 {
 	struct arm_tpiu_swo_object *obj = priv;
-	uint8_t buf[ARM_TPIU_SWO_TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
 	struct arm_tpiu_swo_connection *c;
 
-	int retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
+	/* drain the adapter as long as it fills the whole buffer */
+	for (unsigned int poll = 0; poll < ARM_TPIU_SWO_MAX_POLLS; poll++) {
+		uint8_t *buf = obj->trace_buf;
+		size_t size = ARM_TPIU_SWO_TRACE_BUF_SIZE;
 
-	target_call_trace_callbacks(/*target*/NULL, size, buf);
+		int retval = adapter_poll_trace(buf, &size);
+		if (retval != ERROR_OK)
+			return retval;
 
-	if (obj->file) {
-		if (fwrite(buf, 1, size, obj->file) == size) {
-			fflush(obj->file);
-		} else {
+		obj->stats.polls++;
+		if (!size)
+			break;
+
+		obj->stats.bytes += size;
+
+		target_call_trace_callbacks(/*target*/NULL, size, buf);
+
+		if (obj->itm_decode)
+			itm_decode(obj, buf, size);
+
+		/* the file is flushed periodically, not after each chunk */
+		if (obj->file && fwrite(buf, 1, size, obj->file) != size) {
+			obj->stats.write_errors++;
 			LOG_ERROR("Error writing to the SWO trace destination file");
 			return ERROR_FAIL;
 		}
+
+		if (obj->out_filename[0] == ':')
+			list_for_each_entry(c, &obj->connections, lh)
+				if (connection_write(c->connection, buf, size) != (int)size) {
+					obj->stats.write_errors++;
+					LOG_ERROR("Error writing to connection"); /* FIXME: which connection? */
+				}
+
+		if (size < ARM_TPIU_SWO_TRACE_BUF_SIZE)
+			break;
+
+		obj->stats.full_polls++;
 	}
 
-	if (obj->out_filename[0] == ':')
-		list_for_each_entry(c, &obj->connections, lh)
-			if (connection_write(c->connection, buf, size) != (int)size)
-				LOG_ERROR("Error writing to connection"); /* FIXME: which connection? */
+	int64_t now = timeval_ms();
+	if (now - obj->last_flush_ms >= ARM_TPIU_SWO_FLUSH_INTERVAL_MS) {
+		obj->last_flush_ms = now;
+
+		if (obj->file)
+			fflush(obj->file);
+
+		for (unsigned int i = 0; i < ITM_NUM_STIMULUS_PORTS; i++)
+			if (obj->itm_file[i])
+				fflush(obj->itm_file[i]);
+	}
 
 	return ERROR_OK;
 }
 
+static void arm_tpiu_swo_close_itm_files(struct arm_tpiu_swo_object *obj)
+{
+	for (unsigned int i = 0; i < ITM_NUM_STIMULUS_PORTS; i++) {
+		if (obj->itm_file[i]) {
+			fclose(obj->itm_file[i]);
+			obj->itm_file[i] = NULL;
+		}
+	}
+}
+
 static int arm_tpiu_swo_handle_event(struct arm_tpiu_swo_object *obj, enum arm_tpiu_swo_event event)
 {
 	for (struct arm_tpiu_swo_event_action *ea = obj->event_action; ea; ea = ea->next) {
@@ -204,6 +345,9 @@ static void arm_tpiu_swo_close_output(struct arm_tpiu_swo_object *obj)
 	}
 	if (obj->out_filename[0] == ':')
 		remove_service(TCP_SERVICE_NAME, &obj->out_filename[1]);
+
+	free(obj->trace_buf);
+	obj->trace_buf = NULL;
 }
 
 int arm_tpiu_swo_cleanup_all(void)
@@ -238,6 +382,8 @@ int arm_tpiu_swo_cleanup_all(void)
 		if (obj->ap)
 			dap_put_ap(obj->ap);
 
+		arm_tpiu_swo_close_itm_files(obj);
+
 		free(obj->name);
 		free(obj->out_filename);
 		free(obj);
@@ -719,10 +865,17 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 	unsigned int swo_pin_freq = obj->swo_pin_freq; /* could be replaced */
 
 	if (!output_external) {
+		obj->trace_buf = malloc(ARM_TPIU_SWO_TRACE_BUF_SIZE);
+		if (!obj->trace_buf) {
+			LOG_ERROR("Out of memory");
+			return ERROR_FAIL;
+		}
+
 		if (obj->out_filename[0] == ':') {
 			struct arm_tpiu_swo_priv_connection *priv = malloc(sizeof(*priv));
 			if (!priv) {
 				LOG_ERROR("Out of memory");
+				arm_tpiu_swo_close_output(obj);
 				return ERROR_FAIL;
 			}
 			priv->obj = obj;
@@ -731,12 +884,15 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 				CONNECTION_LIMIT_UNLIMITED, priv);
 			if (retval != ERROR_OK) {
 				command_print(CMD, "Can't configure trace TCP port %s", &obj->out_filename[1]);
+				free(obj->trace_buf);
+				obj->trace_buf = NULL;
 				return retval;
 			}
 		} else if (strcmp(obj->out_filename, "-")) {
 			obj->file = fopen(obj->out_filename, "ab");
 			if (!obj->file) {
 				command_print(CMD, "Can't open trace destination file \"%s\"", obj->out_filename);
+				arm_tpiu_swo_close_output(obj);
 				return ERROR_FAIL;
 			}
 		}
@@ -765,6 +921,8 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_enable)
 			LOG_INFO("SWO pin data rate adjusted by adapter to %d Hz", swo_pin_freq);
 		obj->swo_pin_freq = swo_pin_freq;
 
+		obj->itm.state = ITM_STATE_HEADER;
+		obj->last_flush_ms = timeval_ms();
 		target_register_timer_callback(arm_tpiu_swo_poll_trace, 1,
 			TARGET_TIMER_TYPE_PERIODIC, obj);
 
@@ -868,6 +1026,87 @@ COMMAND_HANDLER(handle_arm_tpiu_swo_disable)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_arm_tpiu_swo_itm_decode)
+{
+	struct arm_tpiu_swo_object *obj = CMD_DATA;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], obj->itm_decode);
+		obj->itm.state = ITM_STATE_HEADER;
+		if (obj->itm_decode && obj->en_formatter)
+			LOG_WARNING("%s: ITM packets cannot be decoded with the formatter enabled",
+				obj->name);
+	}
+
+	command_print(CMD, "ITM decoding is %s", obj->itm_decode ? "enabled" : "disabled");
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_arm_tpiu_swo_itm_output)
+{
+	struct arm_tpiu_swo_object *obj = CMD_DATA;
+	unsigned int port;
+
+	if (CMD_ARGC < 1 || CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], port);
+	if (port >= ITM_NUM_STIMULUS_PORTS) {
+		command_print(CMD, "invalid stimulus port %u", port);
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (obj->itm_file[port]) {
+		fclose(obj->itm_file[port]);
+		obj->itm_file[port] = NULL;
+	}
+
+	if (CMD_ARGC == 2) {
+		obj->itm_file[port] = fopen(CMD_ARGV[1], "ab");
+		if (!obj->itm_file[port]) {
+			command_print(CMD, "Can't open stimulus port destination file \"%s\"", CMD_ARGV[1]);
+			return ERROR_FAIL;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_arm_tpiu_swo_stats)
+{
+	struct arm_tpiu_swo_object *obj = CMD_DATA;
+	struct arm_tpiu_swo_stats *stats = &obj->stats;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "clear"))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		memset(stats, 0, sizeof(*stats));
+		return ERROR_OK;
+	}
+
+	command_print(CMD, "bytes: %" PRIu64, stats->bytes);
+	command_print(CMD, "polls: %" PRIu64 ", with full buffer: %" PRIu64,
+		stats->polls, stats->full_polls);
+	command_print(CMD, "write errors: %" PRIu64, stats->write_errors);
+	if (obj->itm_decode) {
+		command_print(CMD, "ITM overflows: %" PRIu64, stats->itm_overflows);
+		command_print(CMD, "DWT packets: %" PRIu64, stats->itm_hw_packets);
+		for (unsigned int i = 0; i < ITM_NUM_STIMULUS_PORTS; i++)
+			if (stats->itm_port_bytes[i])
+				command_print(CMD, "ITM port %u: %" PRIu64 " bytes", i,
+					stats->itm_port_bytes[i]);
+	}
+
+	return ERROR_OK;
+}
+
 static const struct command_registration arm_tpiu_swo_instance_command_handlers[] = {
 	{
 		.name = "configure",
@@ -904,6 +1143,27 @@ static const struct command_registration arm_tpiu_swo_instance_command_handlers[
 		.usage = "",
 		.help = "Disables the TPIU/SWO output",
 	},
+	{
+		.name = "itm_decode",
+		.mode = COMMAND_ANY,
+		.handler = handle_arm_tpiu_swo_itm_decode,
+		.usage = "['enable'|'disable']",
+		.help = "Decodes the ITM packets of the captured trace",
+	},
+	{
+		.name = "itm_output",
+		.mode = COMMAND_ANY,
+		.handler = handle_arm_tpiu_swo_itm_output,
+		.usage = "port [filename]",
+		.help = "Writes the data of an ITM stimulus port to a file",
+	},
+	{
+		.name = "stats",
+		.mode = COMMAND_ANY,
+		.handler = handle_arm_tpiu_swo_stats,
+		.usage = "['clear']",
+		.help = "Displays the trace capture counters",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
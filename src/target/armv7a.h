@@ -136,6 +136,8 @@ static inline bool is_armv7a(struct armv7a_common *armv7a)
 /* See ARMv7a arch spec section C10.3 */
 #define CPUDBG_WFAR		0x018
 /* PCSR at 0x084 -or- 0x0a0 -or- both ... based on flags in DIDR */
+#define CPUDBG_PCSR_V7		0x084
+#define CPUDBG_PCSR		0x0A0
 #define CPUDBG_DSCR		0x088
 #define CPUDBG_DRCR		0x090
 #define CPUDBG_PRCR		0x310
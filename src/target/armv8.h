@@ -256,6 +256,7 @@ static inline bool is_armv8(struct armv8_common *armv8)
 #define CPUV8_DBG_EDECR		0x24
 #define CPUV8_DBG_EDWAR0	0x30
 #define CPUV8_DBG_EDWAR1	0x34
+#define CPUV8_DBG_EDPCSRLO	0x0A0
 #define CPUV8_DBG_DSCR		0x088
 #define CPUV8_DBG_DRCR		0x090
 #define CPUV8_DBG_ECCR		0x098
@@ -2965,6 +2965,24 @@ static int cortex_a_examine_first(struct target *target)
 	cortex_a->didr = didr;
 	cortex_a->cpuid = cpuid;
 
+	/* PC sampling register, at 0x0a0 when DBGDEVID.PCsample is set,
+	 * at 0x084 when DBGDIDR.PCSR_imp is set */
+	cortex_a->pcsr_offset = 0;
+	if (didr & (1 << 12)) {
+		uint32_t devid;
+
+		retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
+				armv7a->debug_base + CPUDBG_DEVID, &devid);
+		if (retval != ERROR_OK) {
+			LOG_DEBUG("Examine %s failed", "DEVID");
+			return retval;
+		}
+		if (devid & 0xf)
+			cortex_a->pcsr_offset = CPUDBG_PCSR;
+	}
+	if (!cortex_a->pcsr_offset && (didr & (1 << 13)))
+		cortex_a->pcsr_offset = CPUDBG_PCSR_V7;
+
 	retval = mem_ap_read_atomic_u32(armv7a->debug_ap,
 				    armv7a->debug_base + CPUDBG_PRSR, &dbg_osreg);
 	if (retval != ERROR_OK)
@@ -3376,6 +3394,31 @@ static const struct command_registration cortex_a_command_handlers[] = {
 	COMMAND_REGISTRATION_DONE
 };
 
+static int cortex_a_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples)
+{
+	struct cortex_a_common *cortex_a = target_to_cortex_a(target);
+	struct armv7a_common *armv7a = &cortex_a->armv7a_common;
+
+	if (!cortex_a->pcsr_offset)
+		return ERROR_NOT_IMPLEMENTED;
+
+	/* The register at 0x084 includes an offset depending on the instruction
+	 * set (+8 in ARM state, +4 in Thumb state) which is not removed. A
+	 * sample reads as 0xffffffff while the core is halted. */
+	int retval = mem_ap_read_buf_noincr(armv7a->debug_ap, (uint8_t *)samples, 4,
+			max_num_samples, armv7a->debug_base + cortex_a->pcsr_offset);
+	if (retval != ERROR_OK)
+		return retval;
+
+	for (uint32_t i = 0; i < max_num_samples; i++)
+		samples[i] = le_to_h_u32((uint8_t *)&samples[i]);
+
+	*num_samples = max_num_samples;
+
+	return ERROR_OK;
+}
+
 struct target_type cortexa_target = {
 	.name = "cortex_a",
 
@@ -3422,6 +3465,7 @@ struct target_type cortexa_target = {
 	.write_phys_memory = cortex_a_write_phys_memory,
 	.mmu = cortex_a_mmu,
 	.virt2phys = cortex_a_virt2phys,
+	.sample_pc = cortex_a_sample_pc,
 };
 
 static const struct command_registration cortex_r4_exec_command_handlers[] = {
@@ -3494,4 +3538,5 @@ struct target_type cortexr4_target = {
 	.init_target = cortex_a_init_target,
 	.examine = cortex_a_examine,
 	.deinit_target = cortex_a_deinit_target,
+	.sample_pc = cortex_a_sample_pc,
 };
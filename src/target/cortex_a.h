@@ -32,6 +32,7 @@
 #define CPUDBG_CPUID	0xD00
 #define CPUDBG_CTYPR	0xD04
 #define CPUDBG_TTYPR	0xD0C
+#define CPUDBG_DEVID	0xFC8
 #define CPUDBG_LOCKACCESS 0xFB0
 #define CPUDBG_LOCKSTATUS 0xFB4
 #define CPUDBG_OSLAR_LK_MASK (1 << 1)
@@ -95,6 +96,8 @@ struct cortex_a_common {
 
 	uint32_t cpuid;
 	uint32_t didr;
+	/* offset of the PC sampling register from debug_base, 0 if none */
+	uint32_t pcsr_offset;
 
 	enum cortex_a_isrmasking_mode isrmasking_mode;
 	enum cortex_a_dacrfixup_mode dacrfixup_mode;
@@ -2278,11 +2278,43 @@ void cortex_m_deinit_target(struct target *target)
 	free(cortex_m);
 }
 
+int cortex_m_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	int retval = ERROR_OK;
+
+	if (armv7m && armv7m->debug_ap) {
+		/* queue all the reads in a single transaction */
+		retval = mem_ap_read_buf_noincr(armv7m->debug_ap,
+					(void *)samples, 4, max_num_samples, DWT_PCSR);
+		if (retval == ERROR_OK)
+			*num_samples = max_num_samples;
+	} else {
+		*num_samples = 0;
+		for (uint32_t i = 0; i < max_num_samples && retval == ERROR_OK; i++) {
+			retval = target_read_u32(target, DWT_PCSR, &samples[i]);
+			if (retval == ERROR_OK)
+				*num_samples = i + 1;
+		}
+	}
+
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "Error while reading PCSR");
+		return retval;
+	}
+
+	/* PCSR reads as zero when it is not implemented */
+	if (*num_samples && samples[0] == 0)
+		return ERROR_NOT_IMPLEMENTED;
+
+	return ERROR_OK;
+}
+
 int cortex_m_profiling(struct target *target, uint32_t *samples,
 			      uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
 	struct timeval timeout, now;
-	struct armv7m_common *armv7m = target_to_armv7m(target);
 	uint32_t reg_value;
 	int retval;
 
@@ -2314,24 +2346,14 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 	uint32_t sample_count = 0;
 
 	for (;;) {
-		if (armv7m && armv7m->debug_ap) {
-			uint32_t read_count = max_num_samples - sample_count;
-			if (read_count > 1024)
-				read_count = 1024;
-
-			retval = mem_ap_read_buf_noincr(armv7m->debug_ap,
-						(void *)&samples[sample_count],
-						4, read_count, DWT_PCSR);
-			sample_count += read_count;
-		} else {
-			target_read_u32(target, DWT_PCSR, &samples[sample_count++]);
-		}
+		uint32_t read_count = MIN(max_num_samples - sample_count, 1024);
 
-		if (retval != ERROR_OK) {
-			LOG_TARGET_ERROR(target, "Error while reading PCSR");
+		retval = cortex_m_sample_pc(target, &samples[sample_count],
+				read_count, &read_count);
+		if (retval != ERROR_OK)
 			return retval;
-		}
 
+		sample_count += read_count;
 
 		gettimeofday(&now, NULL);
 		if (sample_count >= max_num_samples || timeval_compare(&now, &timeout) > 0) {
@@ -3205,4 +3227,5 @@ struct target_type cortexm_target = {
 	.deinit_target = cortex_m_deinit_target,
 
 	.profiling = cortex_m_profiling,
+	.sample_pc = cortex_m_sample_pc,
 };
@@ -23,6 +23,8 @@
 
 #include "image.h"
 #include "target.h"
+#include <helper/configuration.h>
+#include <helper/crc32.h>
 #include <helper/log.h>
 #include <server/server.h>
 
@@ -119,12 +121,47 @@ static int identify_image_type(struct image *image, const char *type_string, con
 	return ERROR_OK;
 }
 
+/* Value of the hexadecimal digits with bit 4 set, zero for other characters */
+static const uint8_t image_hex_digits[256] = {
+	['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+	['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+	['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e, ['f'] = 0x1f,
+	['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d, ['E'] = 0x1e, ['F'] = 0x1f,
+};
+
+/* Records hold at most 255 bytes, longer lines are rejected */
+#define IMAGE_HEX_MAX_RECORD	512
+
+/**
+ * Decode the pairs of hexadecimal digits of a record, up to the first
+ * character which is not a digit (usually the end of line).
+ */
+static int image_hex_decode_record(const char *line, uint8_t *record, unsigned int *size)
+{
+	unsigned int n = 0;
+
+	while (image_hex_digits[(uint8_t)line[0]]) {
+		uint8_t high = image_hex_digits[(uint8_t)line[0]];
+		uint8_t low = image_hex_digits[(uint8_t)line[1]];
+
+		if (!low || n == IMAGE_HEX_MAX_RECORD)
+			return ERROR_IMAGE_FORMAT_ERROR;
+
+		record[n++] = ((high & 0x0f) << 4) | (low & 0x0f);
+		line += 2;
+	}
+
+	*size = n;
+	return ERROR_OK;
+}
+
 static int image_ihex_buffer_complete_inner(struct image *image,
 	char *lpsz_line,
 	struct imagesection *section)
 {
 	struct image_ihex *ihex = image->type_private;
 	struct fileio *fileio = ihex->fileio;
+	uint8_t record[IMAGE_HEX_MAX_RECORD];
 	uint32_t full_address;
 	uint32_t cooked_bytes;
 	bool end_rec = false;
@@ -153,23 +190,33 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 			uint32_t count;
 			uint32_t address;
 			uint32_t record_type;
-			uint32_t checksum;
 			uint8_t cal_checksum = 0;
-			size_t bytes_read = 0;
+			unsigned int record_size;
+			const uint8_t *data;
 
 			/* skip comments and blank lines */
 			if ((lpsz_line[0] == '#') || (strlen(lpsz_line + strspn(lpsz_line, "\n\t\r ")) == 0))
 				continue;
 
-			if (sscanf(&lpsz_line[bytes_read], ":%2" SCNx32 "%4" SCNx32 "%2" SCNx32, &count,
-				&address, &record_type) != 3)
+			if (lpsz_line[0] != ':' ||
+					image_hex_decode_record(&lpsz_line[1], record, &record_size) != ERROR_OK ||
+					record_size < 5 || record_size < record[0] + 5u)
 				return ERROR_IMAGE_FORMAT_ERROR;
-			bytes_read += 9;
 
-			cal_checksum += (uint8_t)count;
-			cal_checksum += (uint8_t)(address >> 8);
-			cal_checksum += (uint8_t)address;
-			cal_checksum += (uint8_t)record_type;
+			count = record[0];
+			address = be_to_h_u16(&record[1]);
+			record_type = record[3];
+			data = &record[4];
+
+			/* the checksum is the two's complement of the sum of the other bytes */
+			for (unsigned int i = 0; i < count + 5; i++)
+				cal_checksum += record[i];
+
+			if (cal_checksum != 0) {
+				/* checksum failed */
+				LOG_ERROR("incorrect record checksum found in IHEX file");
+				return ERROR_IMAGE_CHECKSUM;
+			}
 
 			if (record_type == 0) {	/* Data Record */
 				if ((full_address & 0xffff) != address) {
@@ -194,16 +241,10 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 					full_address = (full_address & 0xffff0000) | address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					ihex->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)ihex->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
+				memcpy(&ihex->buffer[cooked_bytes], data, count);
+				cooked_bytes += count;
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 1) {	/* End of File Record */
 				/* finish the current section */
 				image->num_sections++;
@@ -219,15 +260,16 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 
 				end_rec = true;
 				break;
-			} else if (record_type == 2) {	/* Linear Address Record */
-				uint16_t upper_address;
+			} else if (record_type == 2 || record_type == 4) {
+				/* Linear Address Record or Extended Linear Address Record */
+				unsigned int shift = record_type == 2 ? 4 : 16;
+				uint32_t upper_address;
 
-				sscanf(&lpsz_line[bytes_read], "%4hx", &upper_address);
-				cal_checksum += (uint8_t)(upper_address >> 8);
-				cal_checksum += (uint8_t)upper_address;
-				bytes_read += 4;
+				if (count < 2)
+					return ERROR_IMAGE_FORMAT_ERROR;
+				upper_address = be_to_h_u16(data);
 
-				if ((full_address >> 4) != upper_address) {
+				if ((full_address >> shift) != upper_address) {
 					/* we encountered a nonconsecutive location, create a new section,
 					 * unless the current section has zero size, in which case this specifies
 					 * the current section's base address
@@ -245,57 +287,18 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 							&ihex->buffer[cooked_bytes];
 					}
 					section[image->num_sections].base_address =
-						(full_address & 0xffff) | (upper_address << 4);
-					full_address = (full_address & 0xffff) | (upper_address << 4);
+						(full_address & 0xffff) | (upper_address << shift);
+					full_address = (full_address & 0xffff) | (upper_address << shift);
 				}
 			} else if (record_type == 3) {	/* Start Segment Address Record */
-				uint32_t dummy;
-
 				/* "Start Segment Address Record" will not be supported
 				 * but we must consume it, and do not create an error.  */
-				while (count-- > 0) {
-					sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &dummy);
-					cal_checksum += (uint8_t)dummy;
-					bytes_read += 2;
-				}
-			} else if (record_type == 4) {	/* Extended Linear Address Record */
-				uint16_t upper_address;
-
-				sscanf(&lpsz_line[bytes_read], "%4hx", &upper_address);
-				cal_checksum += (uint8_t)(upper_address >> 8);
-				cal_checksum += (uint8_t)upper_address;
-				bytes_read += 4;
-
-				if ((full_address >> 16) != upper_address) {
-					/* we encountered a nonconsecutive location, create a new section,
-					 * unless the current section has zero size, in which case this specifies
-					 * the current section's base address
-					 */
-					if (section[image->num_sections].size != 0) {
-						image->num_sections++;
-						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
-							/* too many sections */
-							LOG_ERROR("Too many sections found in IHEX file");
-							return ERROR_IMAGE_FORMAT_ERROR;
-						}
-						section[image->num_sections].size = 0x0;
-						section[image->num_sections].flags = 0;
-						section[image->num_sections].private =
-							&ihex->buffer[cooked_bytes];
-					}
-					section[image->num_sections].base_address =
-						(full_address & 0xffff) | (upper_address << 16);
-					full_address = (full_address & 0xffff) | (upper_address << 16);
-				}
 			} else if (record_type == 5) {	/* Start Linear Address Record */
 				uint32_t start_address;
 
-				sscanf(&lpsz_line[bytes_read], "%8" SCNx32, &start_address);
-				cal_checksum += (uint8_t)(start_address >> 24);
-				cal_checksum += (uint8_t)(start_address >> 16);
-				cal_checksum += (uint8_t)(start_address >> 8);
-				cal_checksum += (uint8_t)start_address;
-				bytes_read += 8;
+				if (count < 4)
+					return ERROR_IMAGE_FORMAT_ERROR;
+				start_address = be_to_h_u32(data);
 
 				image->start_address_set = true;
 				image->start_address = be_to_h_u32((uint8_t *)&start_address);
@@ -304,14 +307,6 @@ static int image_ihex_buffer_complete_inner(struct image *image,
 				return ERROR_IMAGE_FORMAT_ERROR;
 			}
 
-			sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &checksum);
-
-			if ((uint8_t)checksum != (uint8_t)(~cal_checksum + 1)) {
-				/* checksum failed */
-				LOG_ERROR("incorrect record checksum found in IHEX file");
-				return ERROR_IMAGE_CHECKSUM;
-			}
-
 			if (end_rec) {
 				end_rec = false;
 				LOG_WARNING("continuing after end-of-file record: %.40s", lpsz_line);
@@ -650,6 +645,35 @@ static int image_elf_read_headers(struct image *image)
 	}
 }
 
+/* Read the content of an ELF file, from its mapping when available */
+static int image_elf_read_content(struct image_elf *elf, uint64_t position,
+	size_t size, uint8_t *buffer)
+{
+	if (elf->map) {
+		if (position > elf->map_size || size > elf->map_size - position) {
+			LOG_ERROR("cannot read ELF segment content, beyond end of file");
+			return ERROR_IMAGE_FORMAT_ERROR;
+		}
+		memcpy(buffer, elf->map + position, size);
+		return ERROR_OK;
+	}
+
+	int retval = fileio_seek(elf->fileio, position);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("cannot find ELF segment content, seek failed");
+		return retval;
+	}
+
+	size_t really_read;
+	retval = fileio_read(elf->fileio, size, buffer, &really_read);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("cannot read ELF segment content, read failed");
+		return retval;
+	}
+
+	return ERROR_OK;
+}
+
 static int image_elf32_read_section(struct image *image,
 	int section,
 	target_addr_t offset,
@@ -659,7 +683,7 @@ static int image_elf32_read_section(struct image *image,
 {
 	struct image_elf *elf = image->type_private;
 	Elf32_Phdr *segment = (Elf32_Phdr *)image->sections[section].private;
-	size_t read_size, really_read;
+	size_t read_size;
 	int retval;
 
 	*size_read = 0;
@@ -673,16 +697,10 @@ static int image_elf32_read_section(struct image *image,
 		LOG_DEBUG("read elf: size = 0x%zx at 0x%" TARGET_PRIxADDR "", read_size,
 			field32(elf, segment->p_offset) + offset);
 		/* read initialized area of the segment */
-		retval = fileio_seek(elf->fileio, field32(elf, segment->p_offset) + offset);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot find ELF segment content, seek failed");
-			return retval;
-		}
-		retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot read ELF segment content, read failed");
+		retval = image_elf_read_content(elf, field32(elf, segment->p_offset) + offset,
+				read_size, buffer);
+		if (retval != ERROR_OK)
 			return retval;
-		}
 		size -= read_size;
 		*size_read += read_size;
 		/* need more data ? */
@@ -702,7 +720,7 @@ static int image_elf64_read_section(struct image *image,
 {
 	struct image_elf *elf = image->type_private;
 	Elf64_Phdr *segment = (Elf64_Phdr *)image->sections[section].private;
-	size_t read_size, really_read;
+	size_t read_size;
 	int retval;
 
 	*size_read = 0;
@@ -716,16 +734,10 @@ static int image_elf64_read_section(struct image *image,
 		LOG_DEBUG("read elf: size = 0x%zx at 0x%" TARGET_PRIxADDR "", read_size,
 			field64(elf, segment->p_offset) + offset);
 		/* read initialized area of the segment */
-		retval = fileio_seek(elf->fileio, field64(elf, segment->p_offset) + offset);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot find ELF segment content, seek failed");
-			return retval;
-		}
-		retval = fileio_read(elf->fileio, read_size, buffer, &really_read);
-		if (retval != ERROR_OK) {
-			LOG_ERROR("cannot read ELF segment content, read failed");
+		retval = image_elf_read_content(elf, field64(elf, segment->p_offset) + offset,
+				read_size, buffer);
+		if (retval != ERROR_OK)
 			return retval;
-		}
 		size -= read_size;
 		*size_read += read_size;
 		/* need more data ? */
@@ -757,6 +769,7 @@ static int image_mot_buffer_complete_inner(struct image *image,
 {
 	struct image_mot *mot = image->type_private;
 	struct fileio *fileio = mot->fileio;
+	uint8_t record[IMAGE_HEX_MAX_RECORD];
 	uint32_t full_address;
 	uint32_t cooked_bytes;
 	bool end_rec = false;
@@ -785,67 +798,47 @@ static int image_mot_buffer_complete_inner(struct image *image,
 			uint32_t count;
 			uint32_t address;
 			uint32_t record_type;
-			uint32_t checksum;
 			uint8_t cal_checksum = 0;
-			uint32_t bytes_read = 0;
+			unsigned int record_size;
 
 			/* skip comments and blank lines */
 			if ((lpsz_line[0] == '#') || (strlen(lpsz_line + strspn(lpsz_line, "\n\t\r ")) == 0))
 				continue;
 
-			/* get record type and record length */
-			if (sscanf(&lpsz_line[bytes_read], "S%1" SCNx32 "%2" SCNx32, &record_type,
-				&count) != 2)
+			/* get record type, then record length and content */
+			if (lpsz_line[0] != 'S' || !image_hex_digits[(uint8_t)lpsz_line[1]] ||
+					image_hex_decode_record(&lpsz_line[2], record, &record_size) != ERROR_OK ||
+					record_size < 2 || record_size < record[0] + 1u)
 				return ERROR_IMAGE_FORMAT_ERROR;
 
-			bytes_read += 4;
-			cal_checksum += (uint8_t)count;
+			record_type = image_hex_digits[(uint8_t)lpsz_line[1]] & 0x0f;
+
+			/* account for checksum, the sum of all the bytes will always be 0xFF */
+			for (unsigned int i = 0; i <= record[0]; i++)
+				cal_checksum += record[i];
+
+			if (cal_checksum != 0xFF) {
+				/* checksum failed */
+				LOG_ERROR("incorrect record checksum found in S19 file");
+				return ERROR_IMAGE_CHECKSUM;
+			}
 
 			/* skip checksum byte */
-			count -= 1;
+			count = record[0] - 1;
 
 			if (record_type == 0) {
 				/* S0 - starting record (optional) */
-				int value;
-
-				while (count-- > 0) {
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					cal_checksum += (uint8_t)value;
-					bytes_read += 2;
-				}
 			} else if (record_type >= 1 && record_type <= 3) {
-				switch (record_type) {
-					case 1:
-						/* S1 - 16 bit address data record */
-						sscanf(&lpsz_line[bytes_read], "%4" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 4;
-						count -= 2;
-						break;
-
-					case 2:
-						/* S2 - 24 bit address data record */
-						sscanf(&lpsz_line[bytes_read], "%6" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 16);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 6;
-						count -= 3;
-						break;
-
-					case 3:
-						/* S3 - 32 bit address data record */
-						sscanf(&lpsz_line[bytes_read], "%8" SCNx32, &address);
-						cal_checksum += (uint8_t)(address >> 24);
-						cal_checksum += (uint8_t)(address >> 16);
-						cal_checksum += (uint8_t)(address >> 8);
-						cal_checksum += (uint8_t)address;
-						bytes_read += 8;
-						count -= 4;
-						break;
+				/* S1, S2, S3 - 16, 24 and 32 bit address data records */
+				unsigned int address_size = record_type + 1;
 
-				}
+				if (count < address_size)
+					return ERROR_IMAGE_FORMAT_ERROR;
+
+				address = 0;
+				for (unsigned int i = 0; i < address_size; i++)
+					address = (address << 8) | record[1 + i];
+				count -= address_size;
 
 				if (full_address != address) {
 					/* we encountered a nonconsecutive location, create a new section,
@@ -854,6 +847,11 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					 */
 					if (section[image->num_sections].size != 0) {
 						image->num_sections++;
+						if (image->num_sections >= IMAGE_MAX_SECTIONS) {
+							/* too many sections */
+							LOG_ERROR("Too many sections found in S19 file");
+							return ERROR_IMAGE_FORMAT_ERROR;
+						}
 						section[image->num_sections].size = 0x0;
 						section[image->num_sections].flags = 0;
 						section[image->num_sections].private =
@@ -863,25 +861,12 @@ static int image_mot_buffer_complete_inner(struct image *image,
 					full_address = address;
 				}
 
-				while (count-- > 0) {
-					unsigned value;
-					sscanf(&lpsz_line[bytes_read], "%2x", &value);
-					mot->buffer[cooked_bytes] = (uint8_t)value;
-					cal_checksum += (uint8_t)mot->buffer[cooked_bytes];
-					bytes_read += 2;
-					cooked_bytes += 1;
-					section[image->num_sections].size += 1;
-					full_address++;
-				}
+				memcpy(&mot->buffer[cooked_bytes], &record[1 + address_size], count);
+				cooked_bytes += count;
+				section[image->num_sections].size += count;
+				full_address += count;
 			} else if (record_type == 5 || record_type == 6) {
 				/* S5 and S6 are the data count records, we ignore them */
-				uint32_t dummy;
-
-				while (count-- > 0) {
-					sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &dummy);
-					cal_checksum += (uint8_t)dummy;
-					bytes_read += 2;
-				}
 			} else if (record_type >= 7 && record_type <= 9) {
 				/* S7, S8, S9 - ending records for 32, 24 and 16bit */
 				image->num_sections++;
@@ -902,16 +887,6 @@ static int image_mot_buffer_complete_inner(struct image *image,
 				return ERROR_IMAGE_FORMAT_ERROR;
 			}
 
-			/* account for checksum, will always be 0xFF */
-			sscanf(&lpsz_line[bytes_read], "%2" SCNx32, &checksum);
-			cal_checksum += (uint8_t)checksum;
-
-			if (cal_checksum != 0xFF) {
-				/* checksum failed */
-				LOG_ERROR("incorrect record checksum found in S19 file");
-				return ERROR_IMAGE_CHECKSUM;
-			}
-
 			if (end_rec) {
 				end_rec = false;
 				LOG_WARNING("continuing after end-of-file record: %.40s", lpsz_line);
@@ -954,6 +929,293 @@ static int image_mot_buffer_complete(struct image *image)
 	return retval;
 }
 
+/* Directory of the cache of decoded ihex and srec images, or NULL if disabled */
+static char *image_cache_dir;
+
+/*
+ * A cache file holds, all fields little endian:
+ * - the key: magic, size (u64) of the image file, image type (u32),
+ *   CRC32 of the content of the file (u32), length of the canonical path
+ *   of the file (u32), followed by this path
+ * - start address set (u32), start address (u32), number of sections (u32)
+ *   and size of the decoded data (u32)
+ * - for each section: base address (u64), offset in the data (u32), size (u32)
+ * - the decoded data
+ */
+#define IMAGE_CACHE_MAGIC			"OCDIMGC2"
+#define IMAGE_CACHE_KEY_SIZE		28
+#define IMAGE_CACHE_INFO_SIZE		16
+#define IMAGE_CACHE_SECTION_SIZE	16
+
+static char *image_cache_canonical_path(const char *url)
+{
+	char *path = find_file(url);
+	if (!path)
+		return NULL;
+
+#ifdef HAVE_REALPATH
+	char *canonical = realpath(path, NULL);
+#elif defined(_WIN32)
+	char *canonical = _fullpath(NULL, path, 0);
+#else
+	char *canonical = strdup(path);
+#endif
+	free(path);
+
+	return canonical;
+}
+
+static int image_cache_file_crc(struct fileio *fileio, size_t file_size, uint32_t *crc)
+{
+	const uint8_t *map;
+
+	if (fileio_map(fileio, &map) == ERROR_OK) {
+		*crc = crc32_le(CRC32_POLY_LE, 0, map, file_size);
+		return ERROR_OK;
+	}
+
+	uint8_t *buffer = malloc(64 * 1024);
+	if (!buffer)
+		return ERROR_FAIL;
+
+	int retval = ERROR_OK;
+	*crc = 0;
+	for (size_t offset = 0; offset < file_size; ) {
+		size_t read_bytes;
+
+		retval = fileio_read(fileio, MIN(file_size - offset, 64 * 1024), buffer, &read_bytes);
+		if (retval == ERROR_OK && read_bytes == 0)
+			retval = ERROR_FILEIO_OPERATION_FAILED;
+		if (retval != ERROR_OK)
+			break;
+
+		*crc = crc32_le(CRC32_POLY_LE, *crc, buffer, read_bytes);
+		offset += read_bytes;
+	}
+
+	free(buffer);
+
+	/* the parser then reads the file from its start */
+	if (retval == ERROR_OK)
+		retval = fileio_seek(fileio, 0);
+
+	return retval;
+}
+
+/**
+ * Build the key of the cache of an image: its size, type, the CRC of its
+ * content and its canonical path, which is returned in @a path.
+ */
+static int image_cache_key(struct image *image, struct fileio *fileio,
+		const char *url, uint8_t *key, char **path)
+{
+	size_t file_size;
+	uint32_t crc;
+
+	int retval = fileio_size(fileio, &file_size);
+	if (retval != ERROR_OK)
+		return retval;
+
+	*path = image_cache_canonical_path(url);
+	if (!*path)
+		return ERROR_FAIL;
+
+	retval = image_cache_file_crc(fileio, file_size, &crc);
+	if (retval != ERROR_OK) {
+		free(*path);
+		*path = NULL;
+		return retval;
+	}
+
+	memcpy(key, IMAGE_CACHE_MAGIC, 8);
+	h_u64_to_le(&key[8], file_size);
+	h_u32_to_le(&key[16], image->type);
+	h_u32_to_le(&key[20], crc);
+	h_u32_to_le(&key[24], strlen(*path));
+
+	return ERROR_OK;
+}
+
+static char *image_cache_path(const char *canonical_path)
+{
+	return alloc_printf("%s/%08" PRIx32 ".imgcache", image_cache_dir,
+			crc32_le(CRC32_POLY_LE, 0, canonical_path, strlen(canonical_path)));
+}
+
+/**
+ * Restore the decoded sections of an ihex or srec image from the cache,
+ * if they were saved for the same file with the same content.
+ */
+static int image_cache_load(struct image *image, struct fileio *fileio,
+		const char *url, uint8_t **buffer)
+{
+	uint8_t key[IMAGE_CACHE_KEY_SIZE];
+	uint8_t header[IMAGE_CACHE_KEY_SIZE];
+	uint8_t info[IMAGE_CACHE_INFO_SIZE];
+	struct imagesection *sections = NULL;
+	uint8_t *data = NULL;
+	char *canonical_path = NULL;
+	char *cached_path = NULL;
+	int retval = ERROR_FAIL;
+
+	if (!image_cache_dir ||
+			image_cache_key(image, fileio, url, key, &canonical_path) != ERROR_OK)
+		return ERROR_FAIL;
+
+	size_t path_len = strlen(canonical_path);
+	char *path = image_cache_path(canonical_path);
+	if (!path) {
+		free(canonical_path);
+		return ERROR_FAIL;
+	}
+
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		LOG_DEBUG("no cached content for %s", url);
+		free(path);
+		free(canonical_path);
+		return ERROR_FAIL;
+	}
+
+	cached_path = malloc(path_len);
+	if (!cached_path)
+		goto done;
+
+	if (fread(header, sizeof(header), 1, file) != 1 ||
+			memcmp(header, key, sizeof(key)) != 0 ||
+			(path_len && fread(cached_path, path_len, 1, file) != 1) ||
+			memcmp(cached_path, canonical_path, path_len) != 0) {
+		LOG_DEBUG("cached content of %s is out of date", url);
+		goto done;
+	}
+
+	if (fread(info, sizeof(info), 1, file) != 1)
+		goto done;
+
+	uint32_t num_sections = le_to_h_u32(&info[8]);
+	uint32_t data_size = le_to_h_u32(&info[12]);
+	if (num_sections == 0 || num_sections > IMAGE_MAX_SECTIONS)
+		goto done;
+
+	sections = malloc(num_sections * sizeof(*sections));
+	data = malloc(data_size ? data_size : 1);
+	if (!sections || !data)
+		goto done;
+
+	for (uint32_t i = 0; i < num_sections; i++) {
+		uint8_t entry[IMAGE_CACHE_SECTION_SIZE];
+
+		if (fread(entry, sizeof(entry), 1, file) != 1)
+			goto done;
+
+		uint32_t offset = le_to_h_u32(&entry[8]);
+		uint32_t size = le_to_h_u32(&entry[12]);
+		if (offset > data_size || size > data_size - offset)
+			goto done;
+
+		sections[i].base_address = le_to_h_u64(&entry[0]);
+		sections[i].size = size;
+		sections[i].flags = 0;
+		sections[i].private = &data[offset];
+	}
+
+	if (data_size && fread(data, data_size, 1, file) != 1)
+		goto done;
+
+	if (le_to_h_u32(&info[0])) {
+		image->start_address_set = true;
+		image->start_address = le_to_h_u32(&info[4]);
+	}
+	image->num_sections = num_sections;
+	image->sections = sections;
+	*buffer = data;
+	sections = NULL;
+	data = NULL;
+
+	LOG_DEBUG("using cached content of %s from %s", url, path);
+	retval = ERROR_OK;
+
+done:
+	fclose(file);
+	free(path);
+	free(canonical_path);
+	free(cached_path);
+	free(sections);
+	free(data);
+
+	return retval;
+}
+
+/** Save the decoded sections of an ihex or srec image in the cache. */
+static void image_cache_save(struct image *image, struct fileio *fileio,
+		const char *url, const uint8_t *buffer)
+{
+	uint8_t key[IMAGE_CACHE_KEY_SIZE];
+	uint8_t info[IMAGE_CACHE_INFO_SIZE];
+	char *canonical_path;
+	uint32_t data_size = 0;
+
+	if (!image_cache_dir ||
+			image_cache_key(image, fileio, url, key, &canonical_path) != ERROR_OK)
+		return;
+
+	/* the sections follow each other in the buffer */
+	for (unsigned int i = 0; i < image->num_sections; i++) {
+		uint32_t end = (const uint8_t *)image->sections[i].private - buffer +
+			image->sections[i].size;
+		data_size = MAX(data_size, end);
+	}
+
+	h_u32_to_le(&info[0], image->start_address_set);
+	h_u32_to_le(&info[4], image->start_address);
+	h_u32_to_le(&info[8], image->num_sections);
+	h_u32_to_le(&info[12], data_size);
+
+	char *path = image_cache_path(canonical_path);
+	char *tmp_path = alloc_printf("%s.tmp", path ? path : "");
+	if (!path || !tmp_path) {
+		free(canonical_path);
+		free(path);
+		free(tmp_path);
+		return;
+	}
+
+	/* write a temporary file first, so that a partial cache is never used */
+	size_t path_len = strlen(canonical_path);
+	FILE *file = fopen(tmp_path, "wb");
+	bool ok = file && fwrite(key, sizeof(key), 1, file) == 1 &&
+		(!path_len || fwrite(canonical_path, path_len, 1, file) == 1) &&
+		fwrite(info, sizeof(info), 1, file) == 1;
+
+	for (unsigned int i = 0; ok && i < image->num_sections; i++) {
+		uint8_t entry[IMAGE_CACHE_SECTION_SIZE];
+
+		h_u64_to_le(&entry[0], image->sections[i].base_address);
+		h_u32_to_le(&entry[8], (const uint8_t *)image->sections[i].private - buffer);
+		h_u32_to_le(&entry[12], image->sections[i].size);
+		ok = fwrite(entry, sizeof(entry), 1, file) == 1;
+	}
+
+	if (ok && data_size)
+		ok = fwrite(buffer, data_size, 1, file) == 1;
+	if (file && fclose(file) != 0)
+		ok = false;
+
+	if (ok) {
+		remove(path);
+		ok = rename(tmp_path, path) == 0;
+	}
+
+	if (!ok) {
+		LOG_WARNING("couldn't write the cached content of %s to %s", url, path);
+		remove(tmp_path);
+	}
+
+	free(canonical_path);
+	free(path);
+	free(tmp_path);
+}
+
 int image_open(struct image *image, const char *url, const char *type_string)
 {
 	int retval = ERROR_OK;
@@ -978,6 +1240,11 @@ int image_open(struct image *image, const char *url, const char *type_string)
 			goto free_mem_on_error;
 		}
 
+		/* without a mapping, the file is read on demand */
+		image_binary->map = NULL;
+		if (fileio_map(image_binary->fileio, &image_binary->map) != ERROR_OK)
+			image_binary->map = NULL;
+
 		image->num_sections = 1;
 		image->sections = malloc(sizeof(struct imagesection));
 		image->sections[0].base_address = 0x0;
@@ -992,7 +1259,13 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			goto free_mem_on_error;
 
-		retval = image_ihex_buffer_complete(image);
+		/* decode the file, unless an up to date result is in the cache */
+		retval = image_cache_load(image, image_ihex->fileio, url, &image_ihex->buffer);
+		if (retval != ERROR_OK) {
+			retval = image_ihex_buffer_complete(image);
+			if (retval == ERROR_OK)
+				image_cache_save(image, image_ihex->fileio, url, image_ihex->buffer);
+		}
 		if (retval != ERROR_OK) {
 			LOG_ERROR(
 				"failed buffering IHEX image, check server output for additional information");
@@ -1008,11 +1281,17 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			goto free_mem_on_error;
 
+		image_elf->map = NULL;
 		retval = image_elf_read_headers(image);
 		if (retval != ERROR_OK) {
 			fileio_close(image_elf->fileio);
 			goto free_mem_on_error;
 		}
+
+		/* the segments are then read from the mapping, if possible */
+		if (fileio_size(image_elf->fileio, &image_elf->map_size) != ERROR_OK ||
+				fileio_map(image_elf->fileio, &image_elf->map) != ERROR_OK)
+			image_elf->map = NULL;
 	} else if (image->type == IMAGE_MEMORY) {
 		struct target *target = get_target(url);
 
@@ -1043,7 +1322,12 @@ int image_open(struct image *image, const char *url, const char *type_string)
 		if (retval != ERROR_OK)
 			goto free_mem_on_error;
 
-		retval = image_mot_buffer_complete(image);
+		retval = image_cache_load(image, image_mot->fileio, url, &image_mot->buffer);
+		if (retval != ERROR_OK) {
+			retval = image_mot_buffer_complete(image);
+			if (retval == ERROR_OK)
+				image_cache_save(image, image_mot->fileio, url, image_mot->buffer);
+		}
 		if (retval != ERROR_OK) {
 			LOG_ERROR(
 				"failed buffering S19 image, check server output for additional information");
@@ -1102,6 +1386,13 @@ int image_read_section(struct image *image,
 		if (section != 0)
 			return ERROR_COMMAND_SYNTAX_ERROR;
 
+		if (image_binary->map) {
+			memcpy(buffer, image_binary->map + offset, size);
+			*size_read = size;
+
+			return ERROR_OK;
+		}
+
 		/* seek to offset */
 		retval = fileio_seek(image_binary->fileio, offset);
 		if (retval != ERROR_OK)
@@ -1171,6 +1462,57 @@ int image_read_section(struct image *image,
 	return ERROR_OK;
 }
 
+/**
+ * Get a pointer to the content of a section, without copy. This is possible
+ * for the images kept in memory once decoded and for the binary and ELF
+ * files mapped in memory.
+ *
+ * @returns ERROR_NOT_IMPLEMENTED if the data has to be read with
+ * image_read_section() instead.
+ */
+int image_get_section_data(struct image *image, int section, target_addr_t offset,
+	uint32_t size, const uint8_t **data)
+{
+	if (offset + size > image->sections[section].size)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (image->type == IMAGE_BINARY) {
+		struct image_binary *image_binary = image->type_private;
+
+		if (!image_binary->map)
+			return ERROR_NOT_IMPLEMENTED;
+
+		*data = image_binary->map + offset;
+	} else if (image->type == IMAGE_ELF) {
+		struct image_elf *elf = image->type_private;
+		uint64_t position;
+
+		if (!elf->map)
+			return ERROR_NOT_IMPLEMENTED;
+
+		if (elf->is_64_bit) {
+			Elf64_Phdr *segment = image->sections[section].private;
+			position = field64(elf, segment->p_offset);
+		} else {
+			Elf32_Phdr *segment = image->sections[section].private;
+			position = field32(elf, segment->p_offset);
+		}
+		position += offset;
+
+		if (position > elf->map_size || size > elf->map_size - position)
+			return ERROR_NOT_IMPLEMENTED;
+
+		*data = elf->map + position;
+	} else if (image->type == IMAGE_IHEX || image->type == IMAGE_SRECORD ||
+			image->type == IMAGE_BUILDER) {
+		*data = (const uint8_t *)image->sections[section].private + offset;
+	} else {
+		return ERROR_NOT_IMPLEMENTED;
+	}
+
+	return ERROR_OK;
+}
+
 int image_add_section(struct image *image, target_addr_t base, uint32_t size, uint64_t flags, uint8_t const *data)
 {
 	struct imagesection *section;
@@ -1270,31 +1612,14 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	uint32_t crc = 0xffffffff;
 	LOG_DEBUG("Calculating checksum");
 
-	static uint32_t crc32_table[256];
-
-	static bool first_init;
-	if (!first_init) {
-		/* Initialize the CRC table and the decoding table.  */
-		unsigned int i, j, c;
-		for (i = 0; i < 256; i++) {
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-
-		first_init = true;
-	}
-
 	while (nbytes > 0) {
-		int run = nbytes;
+		uint32_t run = nbytes;
 		if (run > 32768)
 			run = 32768;
 		nbytes -= run;
-		while (run--) {
-			/* as per gdb */
-			crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-		}
+		/* as per gdb */
+		crc = crc32_be(CRC32_POLY_BE, crc, buffer, run);
+		buffer += run;
 		keep_alive();
 		if (openocd_is_shutdown_pending())
 			return ERROR_SERVER_INTERRUPTED;
@@ -1305,3 +1630,38 @@ int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes, uint32_t *c
 	*checksum = crc;
 	return ERROR_OK;
 }
+
+COMMAND_HANDLER(handle_image_cache_dir_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		free(image_cache_dir);
+		image_cache_dir = NULL;
+
+		if (strcmp(CMD_ARGV[0], "off") != 0) {
+			image_cache_dir = strdup(CMD_ARGV[0]);
+			if (!image_cache_dir) {
+				LOG_ERROR("Out of memory");
+				return ERROR_FAIL;
+			}
+		}
+	}
+
+	command_print(CMD, "%s", image_cache_dir ? image_cache_dir : "off");
+
+	return ERROR_OK;
+}
+
+const struct command_registration image_command_handlers[] = {
+	{
+		.name = "image_cache_dir",
+		.handler = handle_image_cache_dir_command,
+		.mode = COMMAND_ANY,
+		.help = "display or set the directory where the decoded content of "
+			"ihex and srec images is cached, 'off' disables the cache",
+		.usage = "[directory|'off']",
+	},
+	COMMAND_REGISTRATION_DONE
+};
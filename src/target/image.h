@@ -17,6 +17,7 @@
 #ifndef OPENOCD_TARGET_IMAGE_H
 #define OPENOCD_TARGET_IMAGE_H
 
+#include <helper/command.h>
 #include <helper/fileio.h>
 #include <helper/replacements.h>
 
@@ -58,6 +59,7 @@ struct image {
 
 struct image_binary {
 	struct fileio *fileio;
+	const uint8_t *map;	/* file mapped in memory, or NULL */
 };
 
 struct image_ihex {
@@ -73,6 +75,8 @@ struct image_memory {
 
 struct image_elf {
 	struct fileio *fileio;
+	const uint8_t *map;	/* file mapped in memory, or NULL */
+	size_t map_size;
 	bool is_64_bit;
 	union {
 		Elf32_Ehdr *header32;
@@ -94,6 +98,8 @@ struct image_mot {
 int image_open(struct image *image, const char *url, const char *type_string);
 int image_read_section(struct image *image, int section, target_addr_t offset,
 		uint32_t size, uint8_t *buffer, size_t *size_read);
+int image_get_section_data(struct image *image, int section, target_addr_t offset,
+		uint32_t size, const uint8_t **data);
 void image_close(struct image *image);
 
 int image_add_section(struct image *image, target_addr_t base, uint32_t size,
@@ -102,6 +108,8 @@ int image_add_section(struct image *image, target_addr_t base, uint32_t size,
 int image_calculate_checksum(const uint8_t *buffer, uint32_t nbytes,
 		uint32_t *checksum);
 
+extern const struct command_registration image_command_handlers[];
+
 #define ERROR_IMAGE_FORMAT_ERROR	(-1400)
 #define ERROR_IMAGE_TYPE_UNKNOWN	(-1401)
 #define ERROR_IMAGE_TEMPORARILY_UNAVAILABLE		(-1402)
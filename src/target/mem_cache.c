@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/list.h>
+
+#include "target.h"
+#include "target_type.h"
+#include "mem_cache.h"
+
+/* Size of a cache page, reads of cacheable regions are done page by page */
+#define MEM_CACHE_PAGE_SIZE	256
+/* Default limit of the memory used by the cache of a target */
+#define MEM_CACHE_DEFAULT_LIMIT	(64 * 1024)
+
+struct mem_cache_region {
+	struct list_head lh;
+	target_addr_t address;
+	uint32_t size;
+};
+
+struct mem_cache_page {
+	bool valid;
+	target_addr_t address;
+	/* value of use_count at last access, for LRU eviction */
+	uint64_t last_use;
+	uint8_t data[MEM_CACHE_PAGE_SIZE];
+};
+
+struct target_mem_cache {
+	struct list_head regions;
+	struct mem_cache_page *pages;
+	unsigned int num_pages;
+	unsigned int max_pages;
+	uint64_t use_count;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t invalidations;
+};
+
+/* set when at least one page is valid in any cache, to make invalidation cheap */
+static bool mem_cache_populated;
+
+static struct target_mem_cache *mem_cache_get(struct target *target)
+{
+	if (!target->mem_cache) {
+		struct target_mem_cache *cache = calloc(1, sizeof(*cache));
+		if (!cache)
+			return NULL;
+
+		INIT_LIST_HEAD(&cache->regions);
+		cache->max_pages = MEM_CACHE_DEFAULT_LIMIT / MEM_CACHE_PAGE_SIZE;
+		target->mem_cache = cache;
+	}
+
+	return target->mem_cache;
+}
+
+static bool mem_cache_page_is_cacheable(struct target_mem_cache *cache,
+		target_addr_t page_address)
+{
+	struct mem_cache_region *region;
+	target_addr_t page_last = page_address + MEM_CACHE_PAGE_SIZE - 1;
+
+	if (page_last < page_address)
+		return false;
+
+	list_for_each_entry(region, &cache->regions, lh) {
+		if (page_address >= region->address &&
+				page_last <= region->address + region->size - 1)
+			return true;
+	}
+
+	return false;
+}
+
+static void mem_cache_drop(struct target_mem_cache *cache)
+{
+	for (unsigned int i = 0; i < cache->num_pages; i++)
+		cache->pages[i].valid = false;
+}
+
+static struct mem_cache_page *mem_cache_lookup(struct target *target,
+		struct target_mem_cache *cache, target_addr_t page_address)
+{
+	struct mem_cache_page *victim = NULL;
+
+	for (unsigned int i = 0; i < cache->num_pages; i++) {
+		struct mem_cache_page *page = &cache->pages[i];
+
+		if (page->valid && page->address == page_address) {
+			cache->hits++;
+			page->last_use = ++cache->use_count;
+			return page;
+		}
+
+		if (!victim || !page->valid ||
+				(victim->valid && page->last_use < victim->last_use))
+			victim = page;
+	}
+
+	cache->misses++;
+
+	/* grow the page array until the limit is reached, then evict */
+	if (cache->num_pages < cache->max_pages && (!victim || victim->valid)) {
+		struct mem_cache_page *pages = realloc(cache->pages,
+				(cache->num_pages + 1) * sizeof(*pages));
+		if (pages) {
+			cache->pages = pages;
+			victim = &cache->pages[cache->num_pages++];
+		}
+	}
+
+	if (!victim)
+		return NULL;
+
+	victim->valid = false;
+	int retval = target->type->read_buffer(target, page_address,
+			MEM_CACHE_PAGE_SIZE, victim->data);
+	if (retval != ERROR_OK)
+		return NULL;
+
+	victim->valid = true;
+	victim->address = page_address;
+	victim->last_use = ++cache->use_count;
+	mem_cache_populated = true;
+
+	return victim;
+}
+
+int target_mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+
+	if (!cache || list_empty(&cache->regions) || cache->max_pages == 0)
+		return target->type->read_buffer(target, address, size, buffer);
+
+	/* a running target can change its memory at any time */
+	if (target->state != TARGET_HALTED) {
+		mem_cache_drop(cache);
+		return target->type->read_buffer(target, address, size, buffer);
+	}
+
+	/* pending range of non cacheable memory, read in one go */
+	target_addr_t direct_address = address;
+	uint32_t direct_size = 0;
+	uint8_t *direct_buffer = buffer;
+	int retval;
+
+	while (size > 0) {
+		target_addr_t page_address = address & ~(target_addr_t)(MEM_CACHE_PAGE_SIZE - 1);
+		uint32_t offset = address - page_address;
+		uint32_t count = MIN(size, MEM_CACHE_PAGE_SIZE - offset);
+
+		if (mem_cache_page_is_cacheable(cache, page_address)) {
+			if (direct_size) {
+				retval = target->type->read_buffer(target, direct_address,
+						direct_size, direct_buffer);
+				if (retval != ERROR_OK)
+					return retval;
+				direct_size = 0;
+			}
+
+			struct mem_cache_page *page = mem_cache_lookup(target, cache, page_address);
+			if (!page) {
+				/* fall back to an uncached read of the requested bytes */
+				retval = target->type->read_buffer(target, address, count, buffer);
+				if (retval != ERROR_OK)
+					return retval;
+			} else {
+				memcpy(buffer, page->data + offset, count);
+			}
+		} else {
+			if (!direct_size) {
+				direct_address = address;
+				direct_buffer = buffer;
+			}
+			direct_size += count;
+		}
+
+		address += count;
+		buffer += count;
+		size -= count;
+	}
+
+	if (direct_size)
+		return target->type->read_buffer(target, direct_address, direct_size,
+				direct_buffer);
+
+	return ERROR_OK;
+}
+
+void target_mem_cache_invalidate(void)
+{
+	if (!mem_cache_populated)
+		return;
+
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (!target->mem_cache)
+			continue;
+
+		mem_cache_drop(target->mem_cache);
+		target->mem_cache->invalidations++;
+	}
+
+	mem_cache_populated = false;
+}
+
+void target_mem_cache_free(struct target *target)
+{
+	struct target_mem_cache *cache = target->mem_cache;
+	struct mem_cache_region *region, *tmp;
+
+	if (!cache)
+		return;
+
+	list_for_each_entry_safe(region, tmp, &cache->regions, lh) {
+		list_del(&region->lh);
+		free(region);
+	}
+
+	free(cache->pages);
+	free(cache);
+	target->mem_cache = NULL;
+}
+
+COMMAND_HANDLER(handle_mem_cache_add_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	target_addr_t address;
+	uint32_t size;
+
+	if (CMD_ARGC != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+
+	if (size == 0 || address + size - 1 < address) {
+		command_print(CMD, "invalid region");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	struct target_mem_cache *cache = mem_cache_get(target);
+	if (!cache) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	struct mem_cache_region *region = malloc(sizeof(*region));
+	if (!region) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	region->address = address;
+	region->size = size;
+	list_add_tail(&region->lh, &cache->regions);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_clear_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_mem_cache_free(target);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_limit_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	struct target_mem_cache *cache = mem_cache_get(target);
+	if (!cache) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	if (CMD_ARGC == 1) {
+		uint32_t limit;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], limit);
+
+		mem_cache_drop(cache);
+		free(cache->pages);
+		cache->pages = NULL;
+		cache->num_pages = 0;
+		cache->max_pages = limit / MEM_CACHE_PAGE_SIZE;
+	}
+
+	command_print(CMD, "%u", cache->max_pages * MEM_CACHE_PAGE_SIZE);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_mem_cache_info_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct target_mem_cache *cache = target->mem_cache;
+	struct mem_cache_region *region;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!cache || list_empty(&cache->regions)) {
+		command_print(CMD, "no cacheable region");
+		return ERROR_OK;
+	}
+
+	list_for_each_entry(region, &cache->regions, lh)
+		command_print(CMD, "region " TARGET_ADDR_FMT " size 0x%" PRIx32,
+				region->address, region->size);
+
+	unsigned int valid = 0;
+	for (unsigned int i = 0; i < cache->num_pages; i++)
+		if (cache->pages[i].valid)
+			valid++;
+
+	command_print(CMD, "pages: %u valid, %u allocated, %u max (%u bytes each)",
+			valid, cache->num_pages, cache->max_pages, MEM_CACHE_PAGE_SIZE);
+	command_print(CMD, "hits: %" PRIu64 ", misses: %" PRIu64 ", invalidations: %" PRIu64,
+			cache->hits, cache->misses, cache->invalidations);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration mem_cache_subcommand_handlers[] = {
+	{
+		.name = "add",
+		.handler = handle_mem_cache_add_command,
+		.mode = COMMAND_ANY,
+		.help = "declare a memory region whose reads can be cached while "
+			"the target is halted",
+		.usage = "address size",
+	},
+	{
+		.name = "clear",
+		.handler = handle_mem_cache_clear_command,
+		.mode = COMMAND_ANY,
+		.help = "remove all the cacheable regions and the cached data",
+		.usage = "",
+	},
+	{
+		.name = "limit",
+		.handler = handle_mem_cache_limit_command,
+		.mode = COMMAND_ANY,
+		.help = "display or set the maximum amount of cached data in bytes",
+		.usage = "[bytes]",
+	},
+	{
+		.name = "info",
+		.handler = handle_mem_cache_info_command,
+		.mode = COMMAND_ANY,
+		.help = "display the cacheable regions and the hit/miss statistics",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration target_mem_cache_command_handlers[] = {
+	{
+		.name = "mem_cache",
+		.mode = COMMAND_ANY,
+		.help = "host side cache of target memory reads",
+		.usage = "",
+		.chain = mem_cache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,40 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_MEM_CACHE_H
+#define OPENOCD_TARGET_MEM_CACHE_H
+
+#include <helper/command.h>
+#include <helper/types.h>
+
+struct target;
+struct target_mem_cache;
+
+/**
+ * @file
+ * Host side cache of target memory reads.
+ *
+ * While a target is halted, the content of the memory regions declared as
+ * cacheable by the user is kept in pages on the host, so that repeated reads
+ * of the same locations (stack frames, globals, code) do not go through the
+ * debug adapter again. The cache is bypassed when the target is not halted
+ * and the caches of all the targets are invalidated on any target event
+ * (resume, step, reset, halt, ...), memory write, algorithm run or flash
+ * operation.
+ */
+
+/**
+ * Read target memory, serving the cacheable regions from the cache.
+ * Called by target_read_buffer() once the arguments have been checked.
+ */
+int target_mem_cache_read(struct target *target, target_addr_t address,
+		uint32_t size, uint8_t *buffer);
+
+/** Drop the cached content of all the targets. */
+void target_mem_cache_invalidate(void);
+
+/** Release the cache of a target being destroyed. */
+void target_mem_cache_free(struct target *target);
+
+extern const struct command_registration target_mem_cache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEM_CACHE_H */
@@ -0,0 +1,398 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/time_support.h>
+
+#include "target.h"
+#include "profile_stream.h"
+
+/* Default time between two bursts of samples */
+#define PROFILE_STREAM_DEFAULT_PERIOD_MS	10
+/* Default number of samples read in a burst */
+#define PROFILE_STREAM_DEFAULT_BURST	1024
+/* Initial size of the histogram, must be a power of 2 */
+#define PROFILE_STREAM_MIN_TABLE_SIZE	1024
+/* Limit of distinct addresses, samples of other addresses are dropped */
+#define PROFILE_STREAM_MAX_ENTRIES	(4 * 1024 * 1024)
+/* Value read from the PC sampling register while the core is halted or sleeping */
+#define PROFILE_STREAM_NO_PC	0xffffffff
+
+/* Histogram entry, a null count marks a free slot */
+struct profile_entry {
+	uint32_t address;
+	uint32_t count;
+};
+
+static struct {
+	struct target *target;
+	bool running;
+	unsigned int period_ms;
+	uint32_t burst;
+	uint32_t *samples;
+
+	/* open addressing hash table of the sampled addresses */
+	struct profile_entry *table;
+	uint32_t table_size;
+	uint32_t num_entries;
+
+	uint64_t num_samples;
+	uint64_t num_no_pc;
+	uint64_t num_dropped;
+	/* sampling time of the previous runs and start of the current one */
+	int64_t elapsed_ms;
+	int64_t start_ms;
+} profile;
+
+static uint32_t profile_hash(uint32_t address)
+{
+	uint32_t h = (address >> 1) * 0x9e3779b1;
+
+	return h ^ (h >> 15);
+}
+
+static struct profile_entry *profile_find_slot(struct profile_entry *table,
+		uint32_t table_size, uint32_t address)
+{
+	uint32_t i = profile_hash(address) & (table_size - 1);
+
+	while (table[i].count && table[i].address != address)
+		i = (i + 1) & (table_size - 1);
+
+	return &table[i];
+}
+
+static int profile_grow_table(void)
+{
+	uint32_t size = profile.table_size ? 2 * profile.table_size : PROFILE_STREAM_MIN_TABLE_SIZE;
+	struct profile_entry *table = calloc(size, sizeof(*table));
+
+	if (!table)
+		return ERROR_FAIL;
+
+	for (uint32_t i = 0; i < profile.table_size; i++) {
+		if (profile.table[i].count)
+			*profile_find_slot(table, size, profile.table[i].address) = profile.table[i];
+	}
+
+	free(profile.table);
+	profile.table = table;
+	profile.table_size = size;
+
+	return ERROR_OK;
+}
+
+static void profile_add_sample(uint32_t address)
+{
+	profile.num_samples++;
+
+	if (address == PROFILE_STREAM_NO_PC) {
+		profile.num_no_pc++;
+		return;
+	}
+
+	struct profile_entry *entry = profile_find_slot(profile.table, profile.table_size, address);
+
+	if (!entry->count) {
+		/* keep the load factor below 3/4 */
+		if (profile.num_entries >= PROFILE_STREAM_MAX_ENTRIES ||
+				(4 * (profile.num_entries + 1) > 3 * profile.table_size &&
+				profile_grow_table() != ERROR_OK)) {
+			profile.num_dropped++;
+			return;
+		}
+
+		entry = profile_find_slot(profile.table, profile.table_size, address);
+		entry->address = address;
+		profile.num_entries++;
+	}
+
+	if (entry->count < UINT32_MAX)
+		entry->count++;
+}
+
+static void profile_clear(void)
+{
+	free(profile.table);
+	profile.table = NULL;
+	profile.table_size = 0;
+	profile.num_entries = 0;
+	profile.num_samples = 0;
+	profile.num_no_pc = 0;
+	profile.num_dropped = 0;
+	profile.elapsed_ms = 0;
+	profile.start_ms = timeval_ms();
+}
+
+static int64_t profile_duration_ms(void)
+{
+	if (!profile.running)
+		return profile.elapsed_ms;
+
+	return profile.elapsed_ms + timeval_ms() - profile.start_ms;
+}
+
+static int profile_stream_timer_callback(void *priv);
+
+static void profile_stop(void)
+{
+	if (!profile.running)
+		return;
+
+	target_unregister_timer_callback(profile_stream_timer_callback, NULL);
+	profile.elapsed_ms += timeval_ms() - profile.start_ms;
+	profile.running = false;
+
+	free(profile.samples);
+	profile.samples = NULL;
+}
+
+static int profile_stream_timer_callback(void *priv)
+{
+	struct target *target = profile.target;
+	uint32_t num_samples;
+
+	if (!profile.running)
+		return ERROR_OK;
+
+	if (!target_was_examined(target) || target->state != TARGET_RUNNING)
+		return ERROR_OK;
+
+	int retval = target_sample_pc(target, profile.samples, profile.burst, &num_samples);
+	if (retval != ERROR_OK) {
+		LOG_TARGET_ERROR(target, "PC sampling failed, profiler stopped");
+		profile_stop();
+		return retval;
+	}
+
+	if (!profile.table && profile_grow_table() != ERROR_OK) {
+		LOG_ERROR("Out of memory");
+		profile_stop();
+		return ERROR_FAIL;
+	}
+
+	for (uint32_t i = 0; i < num_samples; i++)
+		profile_add_sample(profile.samples[i]);
+
+	return ERROR_OK;
+}
+
+void target_profile_stream_free(void)
+{
+	profile_stop();
+	profile_clear();
+	profile.target = NULL;
+}
+
+COMMAND_HANDLER(handle_profile_stream_start_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	unsigned int period_ms = PROFILE_STREAM_DEFAULT_PERIOD_MS;
+	uint32_t burst = PROFILE_STREAM_DEFAULT_BURST;
+
+	if (CMD_ARGC > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC > 0)
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], period_ms);
+	if (CMD_ARGC > 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], burst);
+
+	if (burst == 0) {
+		command_print(CMD, "burst must be at least 1 sample");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	if (!target_was_examined(target)) {
+		command_print(CMD, "Target not examined yet");
+		return ERROR_TARGET_NOT_EXAMINED;
+	}
+
+	profile_stop();
+
+	uint32_t *samples = malloc(burst * sizeof(*samples));
+	if (!samples) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* check that the target can be sampled without being halted */
+	uint32_t num_samples;
+	int retval = target_sample_pc(target, samples, 1, &num_samples);
+	if (retval == ERROR_NOT_IMPLEMENTED) {
+		command_print(CMD, "target %s cannot sample its PC without halting",
+			target_name(target));
+		free(samples);
+		return retval;
+	} else if (retval != ERROR_OK) {
+		free(samples);
+		return retval;
+	}
+
+	/* samples of different targets are not mixed */
+	if (profile.target != target)
+		profile_clear();
+
+	retval = target_register_timer_callback(profile_stream_timer_callback, period_ms,
+			TARGET_TIMER_TYPE_PERIODIC, NULL);
+	if (retval != ERROR_OK) {
+		free(samples);
+		return retval;
+	}
+
+	profile.target = target;
+	profile.period_ms = period_ms;
+	profile.burst = burst;
+	profile.samples = samples;
+	profile.start_ms = timeval_ms();
+	profile.running = true;
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_stream_stop_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	profile_stop();
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_stream_clear_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	profile_clear();
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_profile_stream_info_command)
+{
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!profile.target) {
+		command_print(CMD, "profiler not started");
+		return ERROR_OK;
+	}
+
+	int64_t duration_ms = profile_duration_ms();
+
+	command_print(CMD, "target %s, %s, %u ms period, %" PRIu32 " samples per burst",
+		target_name(profile.target), profile.running ? "running" : "stopped",
+		profile.period_ms, profile.burst);
+	command_print(CMD, "%" PRIu64 " samples in %" PRId64 " ms (%" PRIu64 " samples/s)",
+		profile.num_samples, duration_ms,
+		duration_ms > 0 ? profile.num_samples * 1000 / duration_ms : 0);
+	command_print(CMD, "%" PRIu64 " samples without PC (core halted or sleeping), "
+		"%" PRIu64 " dropped", profile.num_no_pc, profile.num_dropped);
+	command_print(CMD, "%" PRIu32 " distinct addresses, %zu bytes of histogram",
+		profile.num_entries, profile.table_size * sizeof(struct profile_entry));
+
+	return ERROR_OK;
+}
+
+static int profile_entry_compare(const void *a, const void *b)
+{
+	const struct profile_entry *ea = a;
+	const struct profile_entry *eb = b;
+
+	if (ea->count != eb->count)
+		return ea->count < eb->count ? 1 : -1;
+
+	return ea->address < eb->address ? -1 : ea->address > eb->address;
+}
+
+COMMAND_HANDLER(handle_profile_stream_top_command)
+{
+	uint32_t count = 20;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1)
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], count);
+
+	if (!profile.num_entries)
+		return ERROR_OK;
+
+	struct profile_entry *entries = malloc(profile.num_entries * sizeof(*entries));
+	if (!entries) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < profile.table_size; i++)
+		if (profile.table[i].count)
+			entries[n++] = profile.table[i];
+
+	qsort(entries, n, sizeof(*entries), profile_entry_compare);
+
+	uint64_t total = profile.num_samples - profile.num_no_pc;
+	for (uint32_t i = 0; i < n && i < count; i++)
+		command_print(CMD, "0x%8.8" PRIx32 " %10" PRIu32 " %6.2f%%",
+			entries[i].address, entries[i].count,
+			100.0 * entries[i].count / total);
+
+	free(entries);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration profile_stream_subcommand_handlers[] = {
+	{
+		.name = "start",
+		.handler = handle_profile_stream_start_command,
+		.mode = COMMAND_EXEC,
+		.help = "start sampling the PC of the current target in the background",
+		.usage = "[period_ms [burst]]",
+	},
+	{
+		.name = "stop",
+		.handler = handle_profile_stream_stop_command,
+		.mode = COMMAND_EXEC,
+		.help = "stop sampling, the histogram is kept",
+		.usage = "",
+	},
+	{
+		.name = "clear",
+		.handler = handle_profile_stream_clear_command,
+		.mode = COMMAND_EXEC,
+		.help = "discard the samples collected so far",
+		.usage = "",
+	},
+	{
+		.name = "info",
+		.handler = handle_profile_stream_info_command,
+		.mode = COMMAND_EXEC,
+		.help = "display the sampling statistics",
+		.usage = "",
+	},
+	{
+		.name = "top",
+		.handler = handle_profile_stream_top_command,
+		.mode = COMMAND_EXEC,
+		.help = "display the most sampled addresses",
+		.usage = "[count]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration target_profile_stream_command_handlers[] = {
+	{
+		.name = "profile_stream",
+		.mode = COMMAND_EXEC,
+		.help = "continuous PC sampling profiler",
+		.usage = "",
+		.chain = profile_stream_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+#ifndef OPENOCD_TARGET_PROFILE_STREAM_H
+#define OPENOCD_TARGET_PROFILE_STREAM_H
+
+#include <helper/command.h>
+
+/**
+ * @file
+ * Continuous PC sampling profiler.
+ *
+ * While enabled, a periodic timer callback reads bursts of program counter
+ * samples from the current target without halting it (see
+ * target_sample_pc()) and accumulates them in a histogram indexed by
+ * address. Only one entry per distinct address is kept, so the profiler
+ * can run for as long as needed and the hottest addresses can be listed
+ * at any time, e.g. through the Tcl server.
+ */
+
+/** Stop the profiler and release its histogram. */
+void target_profile_stream_free(void);
+
+extern const struct command_registration target_profile_stream_command_handlers[];
+
+#endif /* OPENOCD_TARGET_PROFILE_STREAM_H */
@@ -113,6 +113,10 @@ typedef enum slot {
 #define CMDERR_HALT_RESUME		4
 #define CMDERR_OTHER			7
 
+/* Number of operations without busy response after which a delay is
+ * decreased, see busy_delay_success() */
+#define BUSY_DELAY_DECAY_PERIOD	128
+
 /*** Info about the core being debugged. ***/
 
 struct trigger {
@@ -191,11 +195,27 @@ typedef struct {
 	 * go low. */
 	unsigned int ac_busy_delay;
 
+	/* Same, for the program buffer executions triggered by abstractauto
+	 * during memory accesses. */
+	unsigned int progbuf_busy_delay;
+
+	/* Number of operations completed without a busy response since each of
+	 * the delays above was last changed, see busy_delay_success(). */
+	unsigned int dmi_busy_successes;
+	unsigned int ac_busy_successes;
+	unsigned int progbuf_busy_successes;
+	unsigned int bus_master_read_successes;
+	unsigned int bus_master_write_successes;
+
 	bool abstract_read_csr_supported;
 	bool abstract_write_csr_supported;
 	bool abstract_read_fpr_supported;
 	bool abstract_write_fpr_supported;
 
+	/* Whether the registers can be read in a single batch on halt, see
+	 * register_read_batch_on_halt(). */
+	bool halt_batch_read_supported;
+
 	yes_no_maybe_t has_aampostincrement;
 
 	/* When a function returns some error due to a failure indicated by the
@@ -447,10 +467,31 @@ static uint32_t dtmcontrol_scan(struct target *target, uint32_t out)
 	return in;
 }
 
+static void busy_delay_increase(unsigned int *delay, unsigned int *successes)
+{
+	*delay += *delay / 10 + 1;
+	*successes = 0;
+}
+
+/* Decrease a delay again after a run of operations without busy response,
+ * so that a single slow operation doesn't slow down the rest of the session.
+ * The decrease is slower than the increase to limit the oscillations. */
+static void busy_delay_success(unsigned int *delay, unsigned int *successes)
+{
+	if (*delay == 0)
+		return;
+
+	if (++*successes < BUSY_DELAY_DECAY_PERIOD)
+		return;
+
+	*successes = 0;
+	*delay -= *delay / 16 + 1;
+}
+
 static void increase_dmi_busy_delay(struct target *target)
 {
 	riscv013_info_t *info = get_info(target);
-	info->dmi_busy_delay += info->dmi_busy_delay / 10 + 1;
+	busy_delay_increase(&info->dmi_busy_delay, &info->dmi_busy_successes);
 	LOG_DEBUG("dtmcs_idle=%d, dmi_busy_delay=%d, ac_busy_delay=%d",
 			info->dtmcs_idle, info->dmi_busy_delay,
 			info->ac_busy_delay);
@@ -484,6 +525,7 @@ static dmi_status_t dmi_scan(struct target *target, uint32_t *address_in,
 		if (r->reset_delays_wait < 0) {
 			info->dmi_busy_delay = 0;
 			info->ac_busy_delay = 0;
+			info->progbuf_busy_delay = 0;
 		}
 	}
 
@@ -558,6 +600,7 @@ static int dmi_op_timeout(struct target *target, uint32_t *data_in,
 		bool *dmi_busy_encountered, int dmi_op, uint32_t address,
 		uint32_t data_out, int timeout_sec, bool exec, bool ensure_success)
 {
+	riscv013_info_t *info = get_info(target);
 	select_dmi(target);
 
 	dmi_status_t status;
@@ -610,6 +653,8 @@ static int dmi_op_timeout(struct target *target, uint32_t *data_in,
 		return ERROR_FAIL;
 	}
 
+	busy_delay_success(&info->dmi_busy_delay, &info->dmi_busy_successes);
+
 	if (ensure_success) {
 		/* This second loop ensures the request succeeded, and gets back data.
 		 * Note that NOP can result in a 'busy' result as well, but that would be
@@ -711,12 +756,21 @@ static int dmstatus_read(struct target *target, uint32_t *dmstatus,
 static void increase_ac_busy_delay(struct target *target)
 {
 	riscv013_info_t *info = get_info(target);
-	info->ac_busy_delay += info->ac_busy_delay / 10 + 1;
+	busy_delay_increase(&info->ac_busy_delay, &info->ac_busy_successes);
 	LOG_DEBUG("dtmcs_idle=%d, dmi_busy_delay=%d, ac_busy_delay=%d",
 			info->dtmcs_idle, info->dmi_busy_delay,
 			info->ac_busy_delay);
 }
 
+static void increase_progbuf_busy_delay(struct target *target)
+{
+	riscv013_info_t *info = get_info(target);
+	busy_delay_increase(&info->progbuf_busy_delay, &info->progbuf_busy_successes);
+	LOG_DEBUG("dtmcs_idle=%d, dmi_busy_delay=%d, progbuf_busy_delay=%d",
+			info->dtmcs_idle, info->dmi_busy_delay,
+			info->progbuf_busy_delay);
+}
+
 static uint32_t __attribute__((unused)) abstract_register_size(unsigned width)
 {
 	switch (width) {
@@ -804,6 +858,8 @@ static int execute_abstract_command(struct target *target, uint32_t command)
 		return ERROR_FAIL;
 	}
 
+	busy_delay_success(&info->ac_busy_delay, &info->ac_busy_successes);
+
 	return ERROR_OK;
 }
 
@@ -2099,9 +2155,22 @@ static int batch_run(const struct target *target, struct riscv_batch *batch)
 			batch->idle_count = 0;
 			info->dmi_busy_delay = 0;
 			info->ac_busy_delay = 0;
+			info->progbuf_busy_delay = 0;
 		}
 	}
-	return riscv_batch_run(batch);
+
+	int result = riscv_batch_run(batch);
+	if (result != ERROR_OK)
+		return result;
+
+	/* Busy responses to the reads are handled by the callers, a busy
+	 * response to a write shows up on the next DMI access */
+	for (size_t key = 0; key < batch->read_keys_used; key++)
+		if (riscv_batch_get_dmi_read_op(batch, key) == DMI_STATUS_BUSY)
+			return ERROR_OK;
+	busy_delay_success(&info->dmi_busy_delay, &info->dmi_busy_successes);
+
+	return ERROR_OK;
 }
 
 static int sba_supports_access(struct target *target, unsigned int size_bytes)
@@ -2225,7 +2294,7 @@ static int sample_memory_bus_v1(struct target *target,
 		if (get_field(sbcs_read, DM_SBCS_SBBUSYERROR)) {
 			/* Discard this batch (too much hassle to try to recover partial
 			 * data) and try again with a larger delay. */
-			info->bus_master_read_delay += info->bus_master_read_delay / 10 + 1;
+			busy_delay_increase(&info->bus_master_read_delay, &info->bus_master_read_successes);
 			dmi_write(target, DM_SBCS, sbcs_read | DM_SBCS_SBBUSYERROR | DM_SBCS_SBERROR);
 			riscv_batch_free(batch);
 			continue;
@@ -2236,6 +2305,7 @@ static int sample_memory_bus_v1(struct target *target,
 			riscv_batch_free(batch);
 			return ERROR_FAIL;
 		}
+		busy_delay_success(&info->bus_master_read_delay, &info->bus_master_read_successes);
 
 		unsigned int read = 0;
 		for (unsigned int n = 0; n < repeat; n++) {
@@ -2271,6 +2341,34 @@ static int sample_memory(struct target *target,
 	return sample_memory_bus_v1(target, buf, config, until_ms);
 }
 
+static void riscv013_get_busy_delays(struct target *target, unsigned int *delays)
+{
+	RISCV013_INFO(info);
+
+	delays[RISCV_DELAY_DMI] = info->dmi_busy_delay;
+	delays[RISCV_DELAY_ABSTRACT] = info->ac_busy_delay;
+	delays[RISCV_DELAY_PROGBUF] = info->progbuf_busy_delay;
+	delays[RISCV_DELAY_SBA_READ] = info->bus_master_read_delay;
+	delays[RISCV_DELAY_SBA_WRITE] = info->bus_master_write_delay;
+}
+
+static void riscv013_set_busy_delays(struct target *target, const unsigned int *delays)
+{
+	RISCV013_INFO(info);
+
+	info->dmi_busy_delay = delays[RISCV_DELAY_DMI];
+	info->ac_busy_delay = delays[RISCV_DELAY_ABSTRACT];
+	info->progbuf_busy_delay = delays[RISCV_DELAY_PROGBUF];
+	info->bus_master_read_delay = delays[RISCV_DELAY_SBA_READ];
+	info->bus_master_write_delay = delays[RISCV_DELAY_SBA_WRITE];
+
+	info->dmi_busy_successes = 0;
+	info->ac_busy_successes = 0;
+	info->progbuf_busy_successes = 0;
+	info->bus_master_read_successes = 0;
+	info->bus_master_write_successes = 0;
+}
+
 static int init_target(struct command_context *cmd_ctx,
 		struct target *target)
 {
@@ -2306,6 +2404,8 @@ static int init_target(struct command_context *cmd_ctx,
 	generic_info->hart_count = &riscv013_hart_count;
 	generic_info->data_bits = &riscv013_data_bits;
 	generic_info->print_info = &riscv013_print_info;
+	generic_info->get_busy_delays = &riscv013_get_busy_delays;
+	generic_info->set_busy_delays = &riscv013_set_busy_delays;
 	if (!generic_info->version_specific) {
 		generic_info->version_specific = calloc(1, sizeof(riscv013_info_t));
 		if (!generic_info->version_specific)
@@ -2316,10 +2416,8 @@ static int init_target(struct command_context *cmd_ctx,
 
 	info->progbufsize = -1;
 
-	info->dmi_busy_delay = 0;
-	info->bus_master_read_delay = 0;
-	info->bus_master_write_delay = 0;
-	info->ac_busy_delay = 0;
+	/* Start from the delays loaded by the user, if any */
+	riscv013_set_busy_delays(target, generic_info->busy_delays);
 
 	/* Assume all these abstract commands are supported until we learn
 	 * otherwise.
@@ -2330,6 +2428,7 @@ static int init_target(struct command_context *cmd_ctx,
 	info->abstract_write_csr_supported = true;
 	info->abstract_read_fpr_supported = true;
 	info->abstract_write_fpr_supported = true;
+	info->halt_batch_read_supported = true;
 
 	info->has_aampostincrement = YNM_MAYBE;
 
@@ -2789,12 +2888,13 @@ static int read_memory_bus_v1(struct target *target, target_addr_t address,
 			if (dmi_write(target, DM_SBCS, sbcs_read | DM_SBCS_SBBUSYERROR) != ERROR_OK)
 				return ERROR_FAIL;
 			next_address = sb_read_address(target);
-			info->bus_master_read_delay += info->bus_master_read_delay / 10 + 1;
+			busy_delay_increase(&info->bus_master_read_delay, &info->bus_master_read_successes);
 			continue;
 		}
 
 		unsigned error = get_field(sbcs_read, DM_SBCS_SBERROR);
 		if (error == 0) {
+			busy_delay_success(&info->bus_master_read_delay, &info->bus_master_read_successes);
 			next_address = end_address;
 		} else {
 			/* Some error indicating the bus access failed, but not because of
@@ -3158,7 +3258,7 @@ static int read_memory_progbuf_inner(struct target *target, target_addr_t addres
 		 */
 
 		struct riscv_batch *batch = riscv_batch_alloc(target, 32,
-				info->dmi_busy_delay + info->ac_busy_delay);
+				info->dmi_busy_delay + info->progbuf_busy_delay);
 		if (!batch)
 			return ERROR_FAIL;
 
@@ -3191,12 +3291,13 @@ static int read_memory_progbuf_inner(struct target *target, target_addr_t addres
 		switch (info->cmderr) {
 			case CMDERR_NONE:
 				LOG_DEBUG("successful (partial?) memory read");
+				busy_delay_success(&info->progbuf_busy_delay, &info->progbuf_busy_successes);
 				next_index = index + reads;
 				break;
 			case CMDERR_BUSY:
 				LOG_DEBUG("memory read resulted in busy response");
 
-				increase_ac_busy_delay(target);
+				increase_progbuf_busy_delay(target);
 				riscv013_clear_abstract_error(target);
 
 				dmi_write(target, DM_ABSTRACTAUTO, 0);
@@ -3743,7 +3844,7 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 			/* Clear the sticky error flag. */
 			dmi_write(target, DM_SBCS, sbcs | DM_SBCS_SBBUSYERROR);
 			/* Slow down before trying again. */
-			info->bus_master_write_delay += info->bus_master_write_delay / 10 + 1;
+			busy_delay_increase(&info->bus_master_write_delay, &info->bus_master_write_successes);
 		}
 
 		if (get_field(sbcs, DM_SBCS_SBBUSYERROR) || dmi_busy_encountered) {
@@ -3781,6 +3882,8 @@ static int write_memory_bus_v1(struct target *target, target_addr_t address,
 			/* Fail the whole operation */
 			return ERROR_FAIL;
 		}
+
+		busy_delay_success(&info->bus_master_write_delay, &info->bus_master_write_successes);
 	}
 
 	return ERROR_OK;
@@ -3862,7 +3965,7 @@ static int write_memory_progbuf(struct target *target, target_addr_t address,
 		struct riscv_batch *batch = riscv_batch_alloc(
 				target,
 				32,
-				info->dmi_busy_delay + info->ac_busy_delay);
+				info->dmi_busy_delay + info->progbuf_busy_delay);
 		if (!batch)
 			goto error;
 
@@ -3938,13 +4041,14 @@ static int write_memory_progbuf(struct target *target, target_addr_t address,
 		info->cmderr = get_field(abstractcs, DM_ABSTRACTCS_CMDERR);
 		if (info->cmderr == CMDERR_NONE && !dmi_busy_encountered) {
 			LOG_DEBUG("successful (partial?) memory write");
+			busy_delay_success(&info->progbuf_busy_delay, &info->progbuf_busy_successes);
 		} else if (info->cmderr == CMDERR_BUSY || dmi_busy_encountered) {
 			if (info->cmderr == CMDERR_BUSY)
 				LOG_DEBUG("Memory write resulted in abstract command busy response.");
 			else if (dmi_busy_encountered)
 				LOG_DEBUG("Memory write resulted in DMI busy response.");
 			riscv013_clear_abstract_error(target);
-			increase_ac_busy_delay(target);
+			increase_progbuf_busy_delay(target);
 
 			dmi_write(target, DM_ABSTRACTAUTO, 0);
 			result = register_read_direct(target, &cur_addr, GDB_REGNO_S0);
@@ -4076,12 +4180,13 @@ static int riscv013_get_register(struct target *target,
 	int result = ERROR_OK;
 	if (rid == GDB_REGNO_PC) {
 		/* TODO: move this into riscv.c. */
-		result = register_read(target, value, GDB_REGNO_DPC);
+		/* DPC is usually cached by register_read_batch_on_halt() */
+		result = riscv_get_register(target, value, GDB_REGNO_DPC);
 		LOG_DEBUG("[%d] read PC from DPC: 0x%" PRIx64, target->coreid, *value);
 	} else if (rid == GDB_REGNO_PRIV) {
 		uint64_t dcsr;
 		/* TODO: move this into riscv.c. */
-		result = register_read(target, &dcsr, GDB_REGNO_DCSR);
+		result = riscv_get_register(target, &dcsr, GDB_REGNO_DCSR);
 		*value = set_field(0, VIRT_PRIV_V, get_field(dcsr, CSR_DCSR_V));
 		*value = set_field(*value, VIRT_PRIV_PRV, get_field(dcsr, CSR_DCSR_PRV));
 	} else {
@@ -4104,6 +4209,7 @@ static int riscv013_set_register(struct target *target, int rid, uint64_t value)
 	} else if (rid == GDB_REGNO_PC) {
 		LOG_DEBUG("[%d] writing PC to DPC: 0x%" PRIx64, target->coreid, value);
 		register_write_direct(target, GDB_REGNO_DPC, value);
+		target->reg_cache->reg_list[GDB_REGNO_DPC].valid = false;
 		uint64_t actual_value;
 		register_read_direct(target, &actual_value, GDB_REGNO_DPC);
 		LOG_DEBUG("[%d]   actual DPC written: 0x%016" PRIx64, target->coreid, actual_value);
@@ -4117,6 +4223,7 @@ static int riscv013_set_register(struct target *target, int rid, uint64_t value)
 		register_read(target, &dcsr, GDB_REGNO_DCSR);
 		dcsr = set_field(dcsr, CSR_DCSR_PRV, get_field(value, VIRT_PRIV_PRV));
 		dcsr = set_field(dcsr, CSR_DCSR_V, get_field(value, VIRT_PRIV_V));
+		target->reg_cache->reg_list[GDB_REGNO_DCSR].valid = false;
 		return register_write_direct(target, GDB_REGNO_DCSR, dcsr);
 	} else {
 		return register_write_direct(target, rid, value);
@@ -4280,8 +4387,130 @@ static int riscv013_on_step(struct target *target)
 	return riscv013_on_step_or_resume(target, true);
 }
 
+/* CSRs read together with the GPRs when a hart halts. Their value can't
+ * change while the hart is halted, so riscv_get_register() caches them. */
+static const enum gdb_regno halt_batch_csrs[] = {
+	GDB_REGNO_DPC,
+	GDB_REGNO_DCSR,
+	GDB_REGNO_MSTATUS,
+	GDB_REGNO_MEPC,
+	GDB_REGNO_MCAUSE,
+};
+
+/*
+ * Read the GPRs and the CSRs above into the register cache with a single
+ * batch of abstract commands, instead of one command and one wait for idle
+ * per register when the debugger asks for them. Each command is followed by
+ * enough idle cycles for it to complete before its result is read.
+ * If a command fails, nothing is cached and the registers are read one by
+ * one as before.
+ */
+static int register_read_batch_on_halt(struct target *target)
+{
+	RISCV013_INFO(info);
+
+	if (!target->reg_cache || !info->halt_batch_read_supported)
+		return ERROR_OK;
+
+	uint32_t numbers[GDB_REGNO_XPR31 + ARRAY_SIZE(halt_batch_csrs)];
+	unsigned int count = 0;
+	unsigned int last_gpr = riscv_supports_extension(target, 'E') ?
+		GDB_REGNO_XPR15 : GDB_REGNO_XPR31;
+
+	for (unsigned int number = GDB_REGNO_ZERO + 1; number <= last_gpr; number++)
+		numbers[count++] = number;
+	if (info->abstract_read_csr_supported)
+		for (unsigned int i = 0; i < ARRAY_SIZE(halt_batch_csrs); i++)
+			numbers[count++] = halt_batch_csrs[i];
+
+	struct riscv_batch *batch = riscv_batch_alloc(target, 3 * count,
+			info->dmi_busy_delay + info->ac_busy_delay);
+	if (!batch)
+		return ERROR_FAIL;
+
+	size_t keys[ARRAY_SIZE(numbers)];
+	unsigned int queued = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		struct reg *reg = &target->reg_cache->reg_list[numbers[i]];
+		if (!reg->exist || reg->valid || (reg->size != 32 && reg->size != 64))
+			continue;
+
+		riscv_batch_add_dmi_write(batch, DM_COMMAND,
+				access_register_command(target, numbers[i], reg->size,
+					AC_ACCESS_REGISTER_TRANSFER));
+		if (reg->size > 32)
+			riscv_batch_add_dmi_read(batch, DM_DATA1);
+		keys[queued] = riscv_batch_add_dmi_read(batch, DM_DATA0);
+		numbers[queued++] = numbers[i];
+	}
+
+	if (batch_run(target, batch) != ERROR_OK) {
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+
+	uint32_t abstractcs;
+	if (wait_for_idle(target, &abstractcs) != ERROR_OK) {
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+
+	info->cmderr = get_field(abstractcs, DM_ABSTRACTCS_CMDERR);
+	if (info->cmderr != CMDERR_NONE) {
+		if (info->cmderr == CMDERR_BUSY) {
+			/* Give the next commands more time */
+			increase_ac_busy_delay(target);
+		} else {
+			LOG_DEBUG("[%s] batch register read failed (cmderr=%d), "
+					"reading the registers one by one from now on",
+					target_name(target), info->cmderr);
+			info->halt_batch_read_supported = false;
+		}
+		riscv013_clear_abstract_error(target);
+		riscv_batch_free(batch);
+		return ERROR_FAIL;
+	}
+
+	for (unsigned int i = 0; i < queued; i++) {
+		struct reg *reg = &target->reg_cache->reg_list[numbers[i]];
+		size_t key = keys[i];
+
+		uint64_t value = 0;
+		for (unsigned int j = 0; j < reg->size / 32; j++) {
+			/* the DATA1 read of 64-bit registers precedes the DATA0 one */
+			dmi_status_t status = riscv_batch_get_dmi_read_op(batch, key - j);
+			if (status != DMI_STATUS_SUCCESS) {
+				LOG_DEBUG("[%s] batch register read encountered DMI error %d",
+						target_name(target), status);
+				if (status == DMI_STATUS_BUSY)
+					increase_dmi_busy_delay(target);
+				riscv_batch_free(batch);
+				return ERROR_FAIL;
+			}
+			value |= (uint64_t)riscv_batch_get_dmi_read_data(batch, key - j) << (32 * j);
+		}
+
+		buf_set_u64(reg->value, 0, reg->size, value);
+		reg->valid = true;
+		LOG_DEBUG("{%d} %s = 0x%" PRIx64, riscv_current_hartid(target),
+				gdb_regno_name(numbers[i]), value);
+	}
+
+	busy_delay_success(&info->ac_busy_delay, &info->ac_busy_successes);
+
+	riscv_batch_free(batch);
+
+	return ERROR_OK;
+}
+
 static int riscv013_on_halt(struct target *target)
 {
+	if (riscv_select_current_hart(target) != ERROR_OK)
+		return ERROR_FAIL;
+
+	/* Errors are not fatal, the registers are then read on demand */
+	register_read_batch_on_halt(target);
+
 	return ERROR_OK;
 }
 
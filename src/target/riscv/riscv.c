@@ -2727,6 +2727,179 @@ COMMAND_HANDLER(riscv_reset_delays)
 	return ERROR_OK;
 }
 
+static const char * const riscv_busy_delay_names[RISCV_DELAY_COUNT] = {
+	[RISCV_DELAY_DMI] = "dmi",
+	[RISCV_DELAY_ABSTRACT] = "abstract",
+	[RISCV_DELAY_PROGBUF] = "progbuf",
+	[RISCV_DELAY_SBA_READ] = "sba_read",
+	[RISCV_DELAY_SBA_WRITE] = "sba_write",
+};
+
+static void riscv_get_busy_delays(struct target *target, unsigned int *delays)
+{
+	RISCV_INFO(r);
+
+	if (r->get_busy_delays)
+		r->get_busy_delays(target, delays);
+	else
+		memcpy(delays, r->busy_delays, sizeof(r->busy_delays));
+}
+
+static void riscv_set_busy_delays(struct target *target, const unsigned int *delays)
+{
+	RISCV_INFO(r);
+
+	memcpy(r->busy_delays, delays, sizeof(r->busy_delays));
+	if (r->set_busy_delays)
+		r->set_busy_delays(target, delays);
+}
+
+/* Parse "name value" pairs into delays */
+static int riscv_parse_busy_delays(unsigned int argc, const char **argv,
+		unsigned int *delays)
+{
+	if (argc % 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (unsigned int i = 0; i < argc; i += 2) {
+		unsigned int d;
+		for (d = 0; d < RISCV_DELAY_COUNT; d++)
+			if (!strcmp(argv[i], riscv_busy_delay_names[d]))
+				break;
+		if (d == RISCV_DELAY_COUNT) {
+			LOG_ERROR("Unknown delay '%s'", argv[i]);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		if (parse_uint(argv[i + 1], &delays[d]) != ERROR_OK)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	return ERROR_OK;
+}
+
+/* Format the delays as "name value" pairs */
+static void riscv_format_busy_delays(char *buf, size_t size, const unsigned int *delays)
+{
+	size_t len = 0;
+
+	buf[0] = '\0';
+	for (unsigned int d = 0; d < RISCV_DELAY_COUNT && len < size; d++)
+		len += snprintf(buf + len, size - len, "%s%s %u", d ? " " : "",
+				riscv_busy_delay_names[d], delays[d]);
+}
+
+static bool is_riscv_target(struct target *target)
+{
+	return !strcmp(target_type_name(target), "riscv");
+}
+
+COMMAND_HANDLER(riscv_busy_delays)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	unsigned int delays[RISCV_DELAY_COUNT];
+	char buf[128];
+
+	riscv_get_busy_delays(target, delays);
+
+	if (CMD_ARGC > 0) {
+		int retval = riscv_parse_busy_delays(CMD_ARGC, CMD_ARGV, delays);
+		if (retval != ERROR_OK)
+			return retval;
+		riscv_set_busy_delays(target, delays);
+	}
+
+	riscv_format_busy_delays(buf, sizeof(buf), delays);
+	command_print(CMD, "%s", buf);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_save_busy_delays)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	FILE *file = fopen(CMD_ARGV[0], "w");
+	if (!file) {
+		command_print(CMD, "failed to create %s", CMD_ARGV[0]);
+		return ERROR_FAIL;
+	}
+
+	for (struct target *target = all_targets; target; target = target->next) {
+		if (!is_riscv_target(target))
+			continue;
+
+		unsigned int delays[RISCV_DELAY_COUNT];
+		char buf[128];
+
+		riscv_get_busy_delays(target, delays);
+		riscv_format_busy_delays(buf, sizeof(buf), delays);
+		fprintf(file, "%s %s\n", target_name(target), buf);
+	}
+
+	if (fclose(file) != 0) {
+		command_print(CMD, "failed to write %s", CMD_ARGV[0]);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(riscv_load_busy_delays)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	FILE *file = fopen(CMD_ARGV[0], "r");
+	if (!file) {
+		command_print(CMD, "failed to open %s", CMD_ARGV[0]);
+		return ERROR_FAIL;
+	}
+
+	int retval = ERROR_OK;
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		/* target name followed by "name value" pairs */
+		const char *argv[1 + 2 * RISCV_DELAY_COUNT];
+		unsigned int argc = 0;
+		for (char *tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+			if (argc == ARRAY_SIZE(argv)) {
+				argc++;
+				break;
+			}
+			argv[argc++] = tok;
+		}
+
+		if (argc == 0 || argv[0][0] == '#')
+			continue;
+
+		if (argc > ARRAY_SIZE(argv)) {
+			command_print(CMD, "invalid line for target %s", argv[0]);
+			retval = ERROR_FAIL;
+			break;
+		}
+
+		struct target *target = get_target(argv[0]);
+		if (!target || !is_riscv_target(target)) {
+			LOG_WARNING("no RISC-V target named %s, delays ignored", argv[0]);
+			continue;
+		}
+
+		unsigned int delays[RISCV_DELAY_COUNT];
+		riscv_get_busy_delays(target, delays);
+		retval = riscv_parse_busy_delays(argc - 1, argv + 1, delays);
+		if (retval != ERROR_OK) {
+			command_print(CMD, "invalid delays for target %s", argv[0]);
+			break;
+		}
+		riscv_set_busy_delays(target, delays);
+	}
+
+	fclose(file);
+
+	return retval;
+}
+
 COMMAND_HANDLER(riscv_set_ir)
 {
 	if (CMD_ARGC != 2) {
@@ -2958,6 +3131,28 @@ static const struct command_registration riscv_exec_command_handlers[] = {
 			"command resets those learned values after `wait` scans. It's only "
 			"useful for testing OpenOCD itself."
 	},
+	{
+		.name = "busy_delays",
+		.handler = riscv_busy_delays,
+		.mode = COMMAND_ANY,
+		.usage = "[dmi|abstract|progbuf|sba_read|sba_write value]...",
+		.help = "Display or set the number of Run-Test/Idle cycles learned "
+			"for each class of operation."
+	},
+	{
+		.name = "save_busy_delays",
+		.handler = riscv_save_busy_delays,
+		.mode = COMMAND_ANY,
+		.usage = "filename",
+		.help = "Save the learned delays of all the RISC-V targets to a file."
+	},
+	{
+		.name = "load_busy_delays",
+		.handler = riscv_load_busy_delays,
+		.mode = COMMAND_ANY,
+		.usage = "filename",
+		.help = "Load the delays saved by save_busy_delays."
+	},
 	{
 		.name = "resume_order",
 		.handler = riscv_resume_order,
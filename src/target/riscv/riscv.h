@@ -49,6 +49,16 @@ enum riscv_mem_access_method {
 	RISCV_MEM_ACCESS_ABSTRACT
 };
 
+/* Classes of operations with their own learned Run-Test/Idle delay */
+enum riscv_busy_delay {
+	RISCV_DELAY_DMI,
+	RISCV_DELAY_ABSTRACT,
+	RISCV_DELAY_PROGBUF,
+	RISCV_DELAY_SBA_READ,
+	RISCV_DELAY_SBA_WRITE,
+	RISCV_DELAY_COUNT
+};
+
 enum riscv_halt_reason {
 	RISCV_HALT_INTERRUPT,
 	RISCV_HALT_BREAKPOINT,
@@ -132,6 +142,10 @@ struct riscv_info {
 	 * delays, causing them to be relearned. Used for testing. */
 	int reset_delays_wait;
 
+	/* Delays set by `riscv busy_delays` before the target is initialized,
+	 * used as starting point by the version specific code. */
+	unsigned int busy_delays[RISCV_DELAY_COUNT];
+
 	/* This target has been prepped and is ready to step/resume. */
 	bool prepped;
 	/* This target was selected using hasel. */
@@ -188,6 +202,10 @@ struct riscv_info {
 
 	COMMAND_HELPER((*print_info), struct target *target);
 
+	/* Get or set the learned delays, indexed by enum riscv_busy_delay. */
+	void (*get_busy_delays)(struct target *target, unsigned int *delays);
+	void (*set_busy_delays)(struct target *target, const unsigned int *delays);
+
 	/* Storage for vector register types. */
 	struct reg_data_type_vector vector_uint8;
 	struct reg_data_type_vector vector_uint16;
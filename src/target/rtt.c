@@ -10,6 +10,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <helper/log.h>
 #include <helper/binarybuffer.h>
 #include <helper/command.h>
@@ -18,12 +19,26 @@
 
 #include "target.h"
 
-static int read_rtt_channel(struct target *target,
-		const struct rtt_control *ctrl, unsigned int channel_index,
-		enum rtt_channel_type type, struct rtt_channel *channel)
+/* Maximum number of up-channel descriptors read at once while polling. */
+#define RTT_MAX_POLLED_CHANNELS	32
+/* Maximum amount of data read from an up-channel in a single poll. */
+#define RTT_MAX_READ_SIZE	(1024 * 1024)
+/* Size of the first and of the largest read while searching for the control block. */
+#define RTT_FIND_BLOCK_MIN_SIZE	1024
+#define RTT_FIND_BLOCK_MAX_SIZE	(64 * 1024)
+
+/* Buffer receiving the up-channel data, grown up to the largest channel. */
+static uint8_t *read_buffer;
+static size_t read_buffer_size;
+
+/* Location of the last control block found, checked first by the next search. */
+static bool last_cb_valid;
+static target_addr_t last_cb_address;
+static char last_cb_id[RTT_CB_MAX_ID_LENGTH + 1];
+
+static target_addr_t rtt_channel_address(const struct rtt_control *ctrl,
+		unsigned int channel_index, enum rtt_channel_type type)
 {
-	int ret;
-	uint8_t buf[RTT_CHANNEL_SIZE];
 	target_addr_t address;
 
 	address = ctrl->address + RTT_CB_SIZE + (channel_index * RTT_CHANNEL_SIZE);
@@ -31,11 +46,12 @@ static int read_rtt_channel(struct target *target,
 	if (type == RTT_CHANNEL_TYPE_DOWN)
 		address += ctrl->num_up_channels * RTT_CHANNEL_SIZE;
 
-	ret = target_read_buffer(target, address, RTT_CHANNEL_SIZE, buf);
-
-	if (ret != ERROR_OK)
-		return ret;
+	return address;
+}
 
+static void parse_rtt_channel(const uint8_t *buf, target_addr_t address,
+		struct rtt_channel *channel)
+{
 	channel->address = address;
 	channel->name_addr = buf_get_u32(buf + 0, 0, 32);
 	channel->buffer_addr = buf_get_u32(buf + 4, 0, 32);
@@ -43,6 +59,24 @@ static int read_rtt_channel(struct target *target,
 	channel->write_pos = buf_get_u32(buf + 12, 0, 32);
 	channel->read_pos = buf_get_u32(buf + 16, 0, 32);
 	channel->flags = buf_get_u32(buf + 20, 0, 32);
+}
+
+static int read_rtt_channel(struct target *target,
+		const struct rtt_control *ctrl, unsigned int channel_index,
+		enum rtt_channel_type type, struct rtt_channel *channel)
+{
+	int ret;
+	uint8_t buf[RTT_CHANNEL_SIZE];
+	target_addr_t address;
+
+	address = rtt_channel_address(ctrl, channel_index, type);
+
+	ret = target_read_buffer(target, address, RTT_CHANNEL_SIZE, buf);
+
+	if (ret != ERROR_OK)
+		return ret;
+
+	parse_rtt_channel(buf, address, channel);
 
 	return ERROR_OK;
 }
@@ -55,6 +89,10 @@ int target_rtt_start(struct target *target, const struct rtt_control *ctrl,
 
 int target_rtt_stop(struct target *target, void *user_data)
 {
+	free(read_buffer);
+	read_buffer = NULL;
+	read_buffer_size = 0;
+
 	return ERROR_OK;
 }
 
@@ -238,45 +276,115 @@ int target_rtt_read_control_block(struct target *target,
 	return ERROR_OK;
 }
 
+/*
+ * Search for a pattern with the Boyer-Moore-Horspool algorithm, return the
+ * offset of the first match or -1 if the pattern is not found.
+ */
+static ssize_t find_pattern(const uint8_t *buf, size_t buf_size,
+		const uint8_t *pattern, size_t pattern_length)
+{
+	size_t skip[256];
+
+	if (!pattern_length || buf_size < pattern_length)
+		return -1;
+
+	for (size_t i = 0; i < ARRAY_SIZE(skip); i++)
+		skip[i] = pattern_length;
+
+	for (size_t i = 0; i < pattern_length - 1; i++)
+		skip[pattern[i]] = pattern_length - 1 - i;
+
+	const uint8_t last = pattern[pattern_length - 1];
+
+	for (size_t off = 0; off <= buf_size - pattern_length;
+			off += skip[buf[off + pattern_length - 1]]) {
+		if (buf[off + pattern_length - 1] == last &&
+				!memcmp(buf + off, pattern, pattern_length - 1))
+			return off;
+	}
+
+	return -1;
+}
+
 int target_rtt_find_control_block(struct target *target,
 		target_addr_t *address, size_t size, const char *id, bool *found,
 		void *user_data)
 {
 	target_addr_t address_end = *address + size;
-	uint8_t buf[1024];
+	const size_t id_length = strlen(id);
+	size_t block_size = RTT_FIND_BLOCK_MIN_SIZE;
+	size_t kept = 0;
+	uint8_t *buf;
+	int ret;
 
 	*found = false;
 
-	size_t id_matched_length = 0;
-	const size_t id_length = strlen(id);
+	if (!id_length || size < id_length)
+		return ERROR_OK;
+
+	/* Check the location of the previously found control block first. */
+	if (last_cb_valid && !strcmp(last_cb_id, id) &&
+			last_cb_address >= *address &&
+			last_cb_address <= address_end - id_length) {
+		uint8_t id_buf[RTT_CB_MAX_ID_LENGTH];
+
+		ret = target_read_buffer(target, last_cb_address, id_length, id_buf);
+
+		if (ret == ERROR_OK && !memcmp(id_buf, id, id_length)) {
+			LOG_DEBUG("rtt: Control block found at the previous location");
+			*address = last_cb_address;
+			*found = true;
+			return ERROR_OK;
+		}
+	}
 
 	LOG_INFO("rtt: Searching for control block '%s'", id);
 
-	for (target_addr_t addr = *address; addr < address_end; addr += sizeof(buf)) {
-		int ret;
+	/*
+	 * The last (id_length - 1) bytes of a block are kept at the start of the
+	 * buffer so that an ID crossing a block boundary is found.
+	 */
+	buf = malloc(RTT_FIND_BLOCK_MAX_SIZE + id_length - 1);
 
-		const size_t buf_size = MIN(sizeof(buf), address_end - addr);
-		ret = target_read_buffer(target, addr, buf_size, buf);
+	if (!buf) {
+		LOG_ERROR("rtt: Failed to allocate search buffer");
+		return ERROR_FAIL;
+	}
 
-		if (ret != ERROR_OK)
-			return ret;
+	for (target_addr_t addr = *address; addr < address_end;) {
+		const size_t read_size = MIN(block_size, address_end - addr);
 
-		for (size_t buf_off = 0; buf_off < buf_size; buf_off++) {
-			if (id_matched_length > 0 &&
-			    buf[buf_off] != id[id_matched_length]) {
-				/* Start from beginning */
-				id_matched_length = 0;
-			}
+		ret = target_read_buffer(target, addr, read_size, buf + kept);
 
-			if (buf[buf_off] == id[id_matched_length])
-				id_matched_length++;
+		if (ret != ERROR_OK) {
+			free(buf);
+			return ret;
+		}
 
-			if (id_matched_length == id_length) {
-				*address = addr + buf_off + 1 - id_length;
-				*found = true;
-				return ERROR_OK;
-			}
+		const size_t buf_size = kept + read_size;
+		const ssize_t off = find_pattern(buf, buf_size, (const uint8_t *)id,
+			id_length);
+
+		if (off >= 0) {
+			*address = addr - kept + off;
+			*found = true;
+			break;
 		}
+
+		kept = MIN(buf_size, id_length - 1);
+		memmove(buf, buf + buf_size - kept, kept);
+		addr += read_size;
+
+		/* Grow the reads to amortize the transfer overhead. */
+		block_size = MIN(2 * block_size, RTT_FIND_BLOCK_MAX_SIZE);
+	}
+
+	free(buf);
+
+	if (*found) {
+		last_cb_address = *address;
+		strcpy(last_cb_id, id);
+		last_cb_valid = true;
 	}
 
 	return ERROR_OK;
@@ -367,45 +475,82 @@ int target_rtt_read_callback(struct target *target,
 		const struct rtt_control *ctrl, struct rtt_sink_list **sinks,
 		size_t num_channels, void *user_data)
 {
+	uint8_t desc[RTT_MAX_POLLED_CHANNELS * RTT_CHANNEL_SIZE];
+	int ret;
+
 	num_channels = MIN(num_channels, ctrl->num_up_channels);
 
-	for (size_t i = 0; i < num_channels; i++) {
-		int ret;
-		struct rtt_channel channel;
-		uint8_t buffer[1024];
-		size_t length;
+	/* Read the up-channel descriptors by batches, each with a single transfer. */
+	for (size_t first = 0; first < num_channels; first += RTT_MAX_POLLED_CHANNELS) {
+		size_t num_batch = MIN(num_channels - first, RTT_MAX_POLLED_CHANNELS);
+		size_t num_polled = 0;
 
-		if (!sinks[i])
+		/* Only fetch the descriptors up to the last channel with a sink. */
+		for (size_t i = 0; i < num_batch; i++) {
+			if (sinks[first + i])
+				num_polled = i + 1;
+		}
+
+		if (!num_polled)
 			continue;
 
-		ret = read_rtt_channel(target, ctrl, i, RTT_CHANNEL_TYPE_UP,
-			&channel);
+		ret = target_read_buffer(target,
+			rtt_channel_address(ctrl, first, RTT_CHANNEL_TYPE_UP),
+			num_polled * RTT_CHANNEL_SIZE, desc);
 
 		if (ret != ERROR_OK) {
-			LOG_ERROR("rtt: Failed to read up-channel %zu description", i);
+			LOG_ERROR("rtt: Failed to read up-channel descriptions");
 			return ret;
 		}
 
-		if (!channel_is_active(&channel)) {
-			LOG_WARNING("rtt: Up-channel %zu is not active", i);
-			continue;
-		}
+		for (size_t i = first; i < first + num_polled; i++) {
+			struct rtt_channel channel;
+			size_t length;
 
-		if (channel.size < RTT_CHANNEL_BUFFER_MIN_SIZE) {
-			LOG_WARNING("rtt: Up-channel %zu is not large enough", i);
-			continue;
-		}
+			if (!sinks[i])
+				continue;
 
-		length = sizeof(buffer);
-		ret = read_from_channel(target, &channel, buffer, &length);
+			parse_rtt_channel(desc + (i - first) * RTT_CHANNEL_SIZE,
+				rtt_channel_address(ctrl, i, RTT_CHANNEL_TYPE_UP), &channel);
 
-		if (ret != ERROR_OK) {
-			LOG_ERROR("rtt: Failed to read from up-channel %zu", i);
-			return ret;
-		}
+			if (!channel_is_active(&channel)) {
+				LOG_WARNING("rtt: Up-channel %zu is not active", i);
+				continue;
+			}
+
+			if (channel.size < RTT_CHANNEL_BUFFER_MIN_SIZE) {
+				LOG_WARNING("rtt: Up-channel %zu is not large enough", i);
+				continue;
+			}
+
+			if (channel.read_pos == channel.write_pos)
+				continue;
+
+			/* Drain everything pending in the ring buffer in one poll. */
+			length = MIN(channel.size, RTT_MAX_READ_SIZE);
 
-		for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next)
-			sink->read(i, buffer, length, sink->user_data);
+			if (read_buffer_size < length) {
+				uint8_t *tmp = realloc(read_buffer, length);
+
+				if (!tmp) {
+					LOG_ERROR("rtt: Failed to allocate read buffer");
+					return ERROR_FAIL;
+				}
+
+				read_buffer = tmp;
+				read_buffer_size = length;
+			}
+
+			ret = read_from_channel(target, &channel, read_buffer, &length);
+
+			if (ret != ERROR_OK) {
+				LOG_ERROR("rtt: Failed to read from up-channel %zu", i);
+				return ret;
+			}
+
+			for (struct rtt_sink_list *sink = sinks[i]; sink; sink = sink->next)
+				sink->read(i, read_buffer, length, sink->user_data);
+		}
 	}
 
 	return ERROR_OK;
@@ -48,6 +48,8 @@
 #include "arm_cti.h"
 #include "smp.h"
 #include "semihosting_common.h"
+#include "mem_cache.h"
+#include "profile_stream.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
@@ -61,6 +63,21 @@ static int target_get_gdb_fileio_info_default(struct target *target,
 		struct gdb_fileio_info *fileio_info);
 static int target_gdb_fileio_end_default(struct target *target, int retcode,
 		int fileio_errno, bool ctrl_c);
+static void target_invalidate_algorithms(struct target *target);
+static void target_invalidate_algorithms_at(struct target *target,
+		target_addr_t address, uint32_t size);
+static bool target_evict_algorithms(struct target *target);
+
+/* Algorithm left loaded in a working area by target_alloc_algorithm() */
+struct algorithm_cache_entry {
+	uint32_t hash;
+	uint32_t size;
+	bool in_use;
+	/* memory overwritten while in use, drop when freed */
+	bool invalid;
+	struct working_area *area;
+	struct algorithm_cache_entry *next;
+};
 
 static struct target_type *target_types[] = {
 	&arm7tdmi_target,
@@ -566,6 +583,16 @@ int target_resume(struct target *target, int current, target_addr_t address,
 
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_START);
 
+	/* user code must not see the data left by the algorithms, and may
+	 * overwrite them; algorithms run with debug_execution keep theirs */
+	if (!debug_execution) {
+		target_invalidate_algorithms(target);
+
+		retval = target_restore_working_area_snapshot(target);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
 	/* note that resume *must* be asynchronous. The CPU can halt before
 	 * we poll. The CPU can even halt at the current PC as a result of
 	 * a software breakpoint being inserted by (a bug?) the application.
@@ -788,6 +815,8 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_mem_cache_invalidate();
+
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -833,6 +862,8 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	target_mem_cache_invalidate();
+
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -939,6 +970,8 @@ int target_run_flash_async_algorithm(struct target *target,
 
 	const uint8_t *buffer_orig = buffer;
 
+	target_mem_cache_invalidate();
+
 	/* Set up working area. First word is write pointer, second word is read pointer,
 	 * rest is fifo data area. */
 	uint32_t wp_addr = buffer_start;
@@ -1273,6 +1306,8 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_mem_cache_invalidate();
+	target_invalidate_algorithms_at(target, address, size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1287,6 +1322,8 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	target_mem_cache_invalidate();
+	target_invalidate_algorithms_at(target, address, size * count);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1414,6 +1451,12 @@ int target_step(struct target *target,
 
 	target_call_event_callbacks(target, TARGET_EVENT_STEP_START);
 
+	target_invalidate_algorithms(target);
+
+	retval = target_restore_working_area_snapshot(target);
+	if (retval != ERROR_OK)
+		return retval;
+
 	retval = target->type->step(target, current, address, handle_breakpoints);
 	if (retval != ERROR_OK)
 		return retval;
@@ -1752,7 +1795,8 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 
 	for (struct target_timer_callback *c = target_timer_callbacks;
 	     c; c = c->next) {
-		if ((c->callback == callback) && (c->priv == priv)) {
+		/* entries already removed are freed on the next timer processing */
+		if ((c->callback == callback) && (c->priv == priv) && !c->removed) {
 			c->removed = true;
 			return ERROR_OK;
 		}
@@ -1775,6 +1819,9 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 			target_event_name(event),
 			target_name(target));
 
+	/* any event may come with changes of the target memory */
+	target_mem_cache_invalidate();
+
 	target_handle_event(target, event);
 
 	while (callback) {
@@ -1793,6 +1840,8 @@ int target_call_reset_callbacks(struct target *target, enum target_reset_mode re
 	LOG_DEBUG("target reset %i (%s)", reset_mode,
 			nvp_value2name(nvp_reset_modes, reset_mode)->name);
 
+	target_mem_cache_invalidate();
+
 	list_for_each_entry(callback, &target_reset_callback_list, list)
 		callback->callback(target, reset_mode, callback->priv);
 
@@ -2015,17 +2064,25 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	/* only allocate multiples of 4 byte */
 	size = ALIGN_UP(size, 4);
 
-	struct working_area *c = target->working_areas;
-
-	/* Find the first large enough working area */
-	while (c) {
-		if (c->free && c->size >= size)
+	/* Find the smallest large enough working area, this keeps the large
+	 * free areas for large requests and lets the usual alloc/free pairs of
+	 * the flash drivers reuse the same area over and over */
+	struct working_area *c = NULL;
+	for (struct working_area *i = target->working_areas; i; i = i->next) {
+		if (!i->free || i->size < size)
+			continue;
+		if (!c || i->size < c->size)
+			c = i;
+		if (c->size == size)
 			break;
-		c = c->next;
 	}
 
-	if (!c)
+	if (!c) {
+		/* Make room by dropping the algorithms which are not in use */
+		if (target_evict_algorithms(target))
+			return target_alloc_working_area_try(target, size, area);
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
 
 	/* Split the working area into the requested size */
 	target_split_working_area(c, size);
@@ -2033,7 +2090,26 @@ int target_alloc_working_area_try(struct target *target, uint32_t size, struct w
 	LOG_DEBUG("allocated new working area of %" PRIu32 " bytes at address " TARGET_ADDR_FMT,
 			  size, c->address);
 
-	if (target->backup_working_area) {
+	if (target->backup_working_area && target->backup_working_area_session) {
+		/* Back up the whole working area on its first use only */
+		if (!target->working_area_snapshot) {
+			struct working_area *first = target->working_areas;
+			uint32_t snapshot_size = ALIGN_DOWN(target->working_area_size, 4);
+			uint8_t *snapshot = malloc(snapshot_size);
+			if (!snapshot)
+				return ERROR_FAIL;
+
+			int retval = target_read_memory(target, first->address, 4,
+					snapshot_size / 4, snapshot);
+			if (retval != ERROR_OK) {
+				free(snapshot);
+				return retval;
+			}
+			target->working_area_snapshot = snapshot;
+			LOG_DEBUG("saved %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
+					snapshot_size, first->address);
+		}
+	} else if (target->backup_working_area) {
 		if (!c->backup) {
 			c->backup = malloc(c->size);
 			if (!c->backup)
@@ -2082,6 +2158,57 @@ static int target_restore_working_area(struct target *target, struct working_are
 	return retval;
 }
 
+/* Hand the own backup of an area over to the session snapshot, so it gets
+ * restored on resume together with the rest of the working area */
+static void target_snapshot_working_area_backup(struct target *target, struct working_area *area)
+{
+	if (!target->working_area_snapshot || !area->backup)
+		return;
+
+	memcpy(target->working_area_snapshot + (area->address - target->working_areas->address),
+			area->backup, area->size);
+	free(area->backup);
+	area->backup = NULL;
+}
+
+int target_restore_working_area_snapshot(struct target *target)
+{
+	uint8_t *snapshot = target->working_area_snapshot;
+	int retval = ERROR_OK;
+
+	if (!snapshot)
+		return ERROR_OK;
+
+	target->working_area_snapshot = NULL;
+
+	for (struct working_area *c = target->working_areas; c; c = c->next) {
+		uint8_t *data = snapshot + (c->address - target->working_areas->address);
+
+		if (!c->free) {
+			/* Still in use, restored when freed as in the default backup mode */
+			if (!c->backup) {
+				c->backup = malloc(c->size);
+				if (c->backup)
+					memcpy(c->backup, data, c->size);
+			}
+			continue;
+		}
+
+		int r = target_write_memory(target, c->address, 4, c->size / 4, data);
+		if (r != ERROR_OK) {
+			LOG_ERROR("failed to restore %" PRIu32 " bytes of working area at address " TARGET_ADDR_FMT,
+					c->size, c->address);
+			retval = r;
+		}
+	}
+
+	free(snapshot);
+
+	LOG_DEBUG("restored working area");
+
+	return retval;
+}
+
 /* Restore the area's backup memory, if any, and return the area to the allocation pool */
 static int target_free_working_area_restore(struct target *target, struct working_area *area, int restore)
 {
@@ -2089,7 +2216,10 @@ static int target_free_working_area_restore(struct target *target, struct workin
 		return ERROR_OK;
 
 	int retval = ERROR_OK;
-	if (restore) {
+	if (restore && target->working_area_snapshot) {
+		/* Deferred until the target resumes */
+		target_snapshot_working_area_backup(target, area);
+	} else if (restore) {
 		retval = target_restore_working_area(target, area);
 		/* REVISIT: Perhaps the area should be freed even if restoring fails. */
 		if (retval != ERROR_OK)
@@ -2132,7 +2262,9 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 	/* Loop through all areas, restoring the allocated ones and marking them as free */
 	while (c) {
 		if (!c->free) {
-			if (restore)
+			if (restore && target->working_area_snapshot)
+				target_snapshot_working_area_backup(target, c);
+			else if (restore)
 				target_restore_working_area(target, c);
 			c->free = true;
 			*c->user = NULL; /* Same as above */
@@ -2141,9 +2273,28 @@ static void target_free_all_working_areas_restore(struct target *target, int res
 		c = c->next;
 	}
 
+	if (restore) {
+		target_restore_working_area_snapshot(target);
+	} else {
+		free(target->working_area_snapshot);
+		target->working_area_snapshot = NULL;
+	}
+
 	/* Run a merge pass to combine all areas into one */
 	target_merge_working_areas(target);
 
+	/* Forget the algorithms, their areas are gone */
+	struct algorithm_cache_entry **p = &target->algorithm_cache;
+	while (*p) {
+		struct algorithm_cache_entry *entry = *p;
+		if (!entry->area) {
+			*p = entry->next;
+			free(entry);
+		} else {
+			p = &entry->next;
+		}
+	}
+
 	print_wa_layout(target);
 }
 
@@ -2179,6 +2330,167 @@ uint32_t target_get_working_area_avail(struct target *target)
 	return max_size;
 }
 
+/* FNV-1a hash of the algorithm code */
+static uint32_t algorithm_hash(const uint8_t *code, uint32_t size)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	for (uint32_t i = 0; i < size; i++)
+		hash = (hash ^ code[i]) * 0x01000193;
+
+	return hash;
+}
+
+/* Unlink a cached algorithm and give its area back to the allocation pool */
+static void algorithm_cache_drop(struct target *target, struct algorithm_cache_entry **p)
+{
+	struct algorithm_cache_entry *entry = *p;
+
+	*p = entry->next;
+	if (entry->area) {
+		LOG_DEBUG("dropping algorithm of %" PRIu32 " bytes at address " TARGET_ADDR_FMT,
+				entry->size, entry->area->address);
+		target_free_working_area(target, entry->area);
+	}
+	free(entry);
+}
+
+/* Drop the algorithms not in use which overlap [address, address + size),
+ * or all of them if size is 0. The ones in use are dropped when freed. */
+static void target_invalidate_algorithms_range(struct target *target,
+		target_addr_t address, uint32_t size)
+{
+	struct algorithm_cache_entry **p = &target->algorithm_cache;
+
+	while (*p) {
+		struct algorithm_cache_entry *entry = *p;
+		bool overlap = !size || (entry->area && address < entry->area->address + entry->area->size &&
+			entry->area->address < address + size);
+
+		if (!overlap) {
+			p = &entry->next;
+		} else if (entry->in_use) {
+			entry->invalid = true;
+			p = &entry->next;
+		} else {
+			algorithm_cache_drop(target, p);
+		}
+	}
+}
+
+static void target_invalidate_algorithms_at(struct target *target,
+		target_addr_t address, uint32_t size)
+{
+	if (size)
+		target_invalidate_algorithms_range(target, address, size);
+}
+
+static void target_invalidate_algorithms(struct target *target)
+{
+	target_invalidate_algorithms_range(target, 0, 0);
+}
+
+/* Drop the algorithms not in use, returns true if any area was freed */
+static bool target_evict_algorithms(struct target *target)
+{
+	struct algorithm_cache_entry **p = &target->algorithm_cache;
+	bool evicted = false;
+
+	while (*p) {
+		if ((*p)->in_use) {
+			p = &(*p)->next;
+		} else {
+			evicted |= (*p)->area != NULL;
+			algorithm_cache_drop(target, p);
+		}
+	}
+
+	return evicted;
+}
+
+int target_alloc_algorithm(struct target *target, const uint8_t *code,
+		uint32_t size, struct working_area **area)
+{
+	uint32_t hash = algorithm_hash(code, size);
+	struct algorithm_cache_entry **p = &target->algorithm_cache;
+	int retval;
+
+	while (*p) {
+		struct algorithm_cache_entry *entry = *p;
+
+		if (entry->in_use || entry->hash != hash || entry->size != size) {
+			p = &entry->next;
+			continue;
+		}
+
+		/* Cheap sanity check of the resident copy: read back its first word */
+		uint8_t first[4];
+		uint32_t count = MIN(size, sizeof(first));
+		retval = entry->area ? target_read_buffer(target, entry->area->address, count, first) : ERROR_FAIL;
+		if (retval != ERROR_OK || memcmp(first, code, count) != 0) {
+			algorithm_cache_drop(target, p);
+			break;
+		}
+
+		LOG_DEBUG("reusing algorithm of %" PRIu32 " bytes at address " TARGET_ADDR_FMT,
+				size, entry->area->address);
+		entry->in_use = true;
+		*area = entry->area;
+		return ERROR_OK;
+	}
+
+	struct algorithm_cache_entry *entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
+
+	/* The cache entry owns the area, target_free_all_working_areas()
+	 * clears entry->area when the area is gone */
+	retval = target_alloc_working_area(target, size, &entry->area);
+	if (retval != ERROR_OK) {
+		free(entry);
+		return retval;
+	}
+
+	retval = target_write_buffer(target, entry->area->address, size, code);
+	if (retval != ERROR_OK) {
+		target_free_working_area(target, entry->area);
+		free(entry);
+		return retval;
+	}
+
+	entry->hash = hash;
+	entry->size = size;
+	entry->in_use = true;
+	entry->next = target->algorithm_cache;
+	target->algorithm_cache = entry;
+
+	*area = entry->area;
+
+	return ERROR_OK;
+}
+
+int target_free_algorithm(struct target *target, struct working_area *area)
+{
+	if (!area)
+		return ERROR_OK;
+
+	for (struct algorithm_cache_entry **p = &target->algorithm_cache; *p; p = &(*p)->next) {
+		struct algorithm_cache_entry *entry = *p;
+
+		if (entry->area != area)
+			continue;
+
+		entry->in_use = false;
+		if (entry->invalid)
+			algorithm_cache_drop(target, p);
+		return ERROR_OK;
+	}
+
+	return target_free_working_area(target, area);
+}
+
 static void target_destroy(struct target *target)
 {
 	breakpoint_remove_all(target);
@@ -2203,6 +2515,8 @@ static void target_destroy(struct target *target)
 
 	target_free_all_working_areas(target);
 
+	target_mem_cache_free(target);
+
 	/* release the targets SMP list */
 	if (target->smp) {
 		struct target_list *head, *tmp;
@@ -2229,6 +2543,8 @@ static void target_destroy(struct target *target)
 
 void target_quit(void)
 {
+	target_profile_stream_free();
+
 	struct target_event_callback *pe = target_event_callbacks;
 	while (pe) {
 		struct target_event_callback *t = pe->next;
@@ -2287,13 +2603,47 @@ static int target_gdb_fileio_end_default(struct target *target,
 	return ERROR_OK;
 }
 
+/* Sample the PC with the target's non-intrusive method, see target_sample_pc() */
+static int target_profiling_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	int64_t end = timeval_ms() + seconds * 1000LL;
+	uint32_t sample_count = 0;
+	int retval = ERROR_OK;
+
+	LOG_TARGET_INFO(target, "Starting profiling. Sampling the PC without halting...");
+
+	while (sample_count < max_num_samples && timeval_ms() < end) {
+		uint32_t read_count = MIN(max_num_samples - sample_count, 1024);
+
+		retval = target_sample_pc(target, &samples[sample_count], read_count, &read_count);
+		if (retval != ERROR_OK)
+			break;
+
+		sample_count += read_count;
+		keep_alive();
+	}
+
+	*num_samples = sample_count;
+	return retval;
+}
+
+/* Maximum share of the time the target is kept halted, in percent */
+#define PROFILING_MAX_PERTURBATION	10
+
 int target_profiling_default(struct target *target, uint32_t *samples,
 		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
-	struct timeval timeout, now;
+	uint32_t probe_count;
 
-	gettimeofday(&timeout, NULL);
-	timeval_add_time(&timeout, seconds, 0);
+	/* Prefer a method which does not stop the target */
+	int retval = target_sample_pc(target, samples, 1, &probe_count);
+	if (retval == ERROR_OK)
+		return target_profiling_sample_pc(target, samples, max_num_samples,
+				num_samples, seconds);
+
+	int64_t start = timeval_ms();
+	int64_t end = start + seconds * 1000LL;
 
 	LOG_INFO("Starting profiling. Halting and resuming the"
 			" target as often as we can...");
@@ -2302,7 +2652,11 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 	/* hopefully it is safe to cache! We want to stop/restart as quickly as possible. */
 	struct reg *reg = register_get_by_name(target->reg_cache, "pc", true);
 
-	int retval = ERROR_OK;
+	/* time the target spent halted for the samples */
+	int64_t halted_ms = 0;
+	int64_t halt_start = 0;
+
+	retval = ERROR_OK;
 	for (;;) {
 		target_poll(target);
 		if (target->state == TARGET_HALTED) {
@@ -2311,9 +2665,23 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 			/* current pc, addr = 0, do not handle breakpoints, not debugging */
 			retval = target_resume(target, 1, 0, 0, 0);
 			target_poll(target);
-			alive_sleep(10); /* sleep 10ms, i.e. <100 samples/second. */
+
+			int64_t now = timeval_ms();
+			int64_t halt_ms = halt_start ? now - halt_start : 0;
+			halted_ms += halt_ms;
+			halt_start = 0;
+
+			/* Leave the target running long enough to keep the time spent
+			 * halted below PROFILING_MAX_PERTURBATION percent. */
+			int64_t sleep_ms = halt_ms * (100 - PROFILING_MAX_PERTURBATION) /
+					PROFILING_MAX_PERTURBATION;
+			if (sleep_ms > 0)
+				alive_sleep(sleep_ms);
+			else
+				keep_alive();
 		} else if (target->state == TARGET_RUNNING) {
 			/* We want to quickly sample the PC. */
+			halt_start = timeval_ms();
 			retval = target_halt(target);
 		} else {
 			LOG_INFO("Target not halted or running");
@@ -2324,9 +2692,13 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 		if (retval != ERROR_OK)
 			break;
 
-		gettimeofday(&now, NULL);
-		if ((sample_count >= max_num_samples) || timeval_compare(&now, &timeout) >= 0) {
-			LOG_INFO("Profiling completed. %" PRIu32 " samples.", sample_count);
+		if (sample_count >= max_num_samples || timeval_ms() >= end) {
+			int64_t duration_ms = timeval_ms() - start;
+
+			LOG_INFO("Profiling completed. %" PRIu32 " samples, %" PRId64 " samples/s, "
+					"target halted %" PRId64 "%% of the time.", sample_count,
+					duration_ms ? sample_count * 1000 / duration_ms : 0,
+					duration_ms ? halted_ms * 100 / duration_ms : 0);
 			break;
 		}
 	}
@@ -2335,6 +2707,20 @@ int target_profiling_default(struct target *target, uint32_t *samples,
 	return retval;
 }
 
+int target_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples)
+{
+	if (!target_was_examined(target)) {
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+
+	if (!target->type->sample_pc)
+		return ERROR_NOT_IMPLEMENTED;
+
+	return target->type->sample_pc(target, samples, max_num_samples, num_samples);
+}
+
 /* Single aligned words are guaranteed to use 16 or 32 bit access
  * mode respectively, otherwise data is handled as quickly as
  * possible
@@ -2360,6 +2746,9 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	target_mem_cache_invalidate();
+	target_invalidate_algorithms_at(target, address, size);
+
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2425,7 +2814,7 @@ int target_read_buffer(struct target *target, target_addr_t address, uint32_t si
 		return ERROR_FAIL;
 	}
 
-	return target->type->read_buffer(target, address, size, buffer);
+	return target_mem_cache_read(target, address, size, buffer);
 }
 
 static int target_read_buffer_default(struct target *target, target_addr_t address, uint32_t count, uint8_t *buffer)
@@ -3633,19 +4022,27 @@ COMMAND_HANDLER(handle_load_image_command)
 	image_size = 0x0;
 	retval = ERROR_OK;
 	for (unsigned int i = 0; i < image.num_sections; i++) {
-		buffer = malloc(image.sections[i].size);
-		if (!buffer) {
-			command_print(CMD,
-						  "error allocating buffer for section (%d bytes)",
-						  (int)(image.sections[i].size));
-			retval = ERROR_FAIL;
-			break;
-		}
+		const uint8_t *data;
+
+		/* write straight from the mapped file or the decoded image if possible */
+		buffer = NULL;
+		buf_cnt = image.sections[i].size;
+		if (image_get_section_data(&image, i, 0x0, image.sections[i].size, &data) != ERROR_OK) {
+			buffer = malloc(image.sections[i].size);
+			if (!buffer) {
+				command_print(CMD,
+							  "error allocating buffer for section (%d bytes)",
+							  (int)(image.sections[i].size));
+				retval = ERROR_FAIL;
+				break;
+			}
 
-		retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
-		if (retval != ERROR_OK) {
-			free(buffer);
-			break;
+			retval = image_read_section(&image, i, 0x0, image.sections[i].size, buffer, &buf_cnt);
+			if (retval != ERROR_OK) {
+				free(buffer);
+				break;
+			}
+			data = buffer;
 		}
 
 		uint32_t offset = 0;
@@ -3666,7 +4063,7 @@ COMMAND_HANDLER(handle_load_image_command)
 				length -= (image.sections[i].base_address + buf_cnt)-max_address;
 
 			retval = target_write_buffer(target,
-					image.sections[i].base_address + offset, length, buffer + offset);
+					image.sections[i].base_address + offset, length, data + offset);
 			if (retval != ERROR_OK) {
 				free(buffer);
 				break;
@@ -3692,6 +4089,174 @@ COMMAND_HANDLER(handle_load_image_command)
 
 }
 
+/* Reads of dump_image start small and grow while they complete quickly */
+#define DUMP_IMAGE_MIN_CHUNK	4096
+#define DUMP_IMAGE_MAX_CHUNK	(1024 * 1024)
+/* Wanted duration of a single read, keeps the servers responsive */
+#define DUMP_IMAGE_CHUNK_MS		100
+/* Granularity of the pages skipped by the sparse formats */
+#define DUMP_IMAGE_PAGE_SIZE	4096
+/* Number of data bytes in an Intel HEX record */
+#define DUMP_IMAGE_IHEX_RECORD	32
+
+enum dump_image_format {
+	DUMP_IMAGE_BIN,
+	DUMP_IMAGE_SPARSE,
+	DUMP_IMAGE_IHEX,
+};
+
+struct dump_image_state {
+	struct fileio *fileio;
+	enum dump_image_format format;
+	/* number of bytes of target memory already processed */
+	size_t offset;
+	/* end of the data written to the file, for the sparse binary format */
+	size_t file_end;
+	/* upper 16 bits of the address of the last Intel HEX record */
+	uint32_t ihex_upper;
+	bool ihex_upper_valid;
+	size_t skipped;
+};
+
+static bool dump_image_page_is_fill(const uint8_t *buffer, size_t size, uint8_t fill)
+{
+	for (size_t i = 0; i < size; i++)
+		if (buffer[i] != fill)
+			return false;
+
+	return true;
+}
+
+static int dump_image_write(struct fileio *fileio, const void *buffer, size_t size)
+{
+	size_t size_written;
+
+	int retval = fileio_write(fileio, size, buffer, &size_written);
+	if (retval == ERROR_OK && size_written != size)
+		retval = ERROR_FILEIO_OPERATION_FAILED;
+
+	return retval;
+}
+
+static int dump_image_write_ihex_record(struct fileio *fileio, uint8_t type,
+		uint16_t address, const uint8_t *data, unsigned int count)
+{
+	static const char hex_digits[] = "0123456789ABCDEF";
+	char line[1 + 2 * (4 + 255 + 1) + 1];
+	uint8_t header[4] = { count, address >> 8, address & 0xff, type };
+	uint8_t checksum = 0;
+	unsigned int len = 0;
+
+	line[len++] = ':';
+	for (unsigned int i = 0; i < 4 + count; i++) {
+		uint8_t byte = i < 4 ? header[i] : data[i - 4];
+		checksum += byte;
+		line[len++] = hex_digits[byte >> 4];
+		line[len++] = hex_digits[byte & 0xf];
+	}
+	checksum = -checksum;
+	line[len++] = hex_digits[checksum >> 4];
+	line[len++] = hex_digits[checksum & 0xf];
+	line[len++] = '\n';
+
+	return dump_image_write(fileio, line, len);
+}
+
+static int dump_image_write_ihex(struct dump_image_state *state, uint32_t address,
+		const uint8_t *buffer, size_t size)
+{
+	while (size > 0) {
+		uint32_t upper = address >> 16;
+		if (!state->ihex_upper_valid || state->ihex_upper != upper) {
+			uint8_t data[2] = { upper >> 8, upper & 0xff };
+			int retval = dump_image_write_ihex_record(state->fileio, 4, 0, data, 2);
+			if (retval != ERROR_OK)
+				return retval;
+			state->ihex_upper = upper;
+			state->ihex_upper_valid = true;
+		}
+
+		/* a record does not cross a 64 KiB boundary */
+		unsigned int count = MIN(size, DUMP_IMAGE_IHEX_RECORD);
+		count = MIN(count, 0x10000 - (address & 0xffff));
+
+		int retval = dump_image_write_ihex_record(state->fileio, 0, address & 0xffff,
+				buffer, count);
+		if (retval != ERROR_OK)
+			return retval;
+
+		address += count;
+		buffer += count;
+		size -= count;
+	}
+
+	return ERROR_OK;
+}
+
+/* Store a chunk of target memory read at the given address */
+static int dump_image_store(struct dump_image_state *state, target_addr_t address,
+		const uint8_t *buffer, size_t size)
+{
+	int retval;
+
+	if (state->format == DUMP_IMAGE_BIN) {
+		state->offset += size;
+		return dump_image_write(state->fileio, buffer, size);
+	}
+
+	for (size_t i = 0; i < size; i += DUMP_IMAGE_PAGE_SIZE) {
+		size_t page_size = MIN(size - i, DUMP_IMAGE_PAGE_SIZE);
+		const uint8_t *page = buffer + i;
+
+		if (state->format == DUMP_IMAGE_SPARSE) {
+			/* erased pages read back as zeros from the hole left in the file */
+			if (dump_image_page_is_fill(page, page_size, 0x00)) {
+				state->skipped += page_size;
+			} else {
+				if (state->file_end != state->offset) {
+					retval = fileio_seek(state->fileio, state->offset);
+					if (retval != ERROR_OK)
+						return retval;
+				}
+				retval = dump_image_write(state->fileio, page, page_size);
+				if (retval != ERROR_OK)
+					return retval;
+				state->file_end = state->offset + page_size;
+			}
+		} else {
+			if (dump_image_page_is_fill(page, page_size, 0x00) ||
+					dump_image_page_is_fill(page, page_size, 0xff)) {
+				state->skipped += page_size;
+			} else {
+				retval = dump_image_write_ihex(state, address + i, page, page_size);
+				if (retval != ERROR_OK)
+					return retval;
+			}
+		}
+
+		state->offset += page_size;
+	}
+
+	return ERROR_OK;
+}
+
+static int dump_image_finish(struct dump_image_state *state)
+{
+	if (state->format == DUMP_IMAGE_IHEX)
+		return dump_image_write_ihex_record(state->fileio, 1, 0, NULL, 0);
+
+	/* extend the file up to the end of a trailing hole */
+	if (state->format == DUMP_IMAGE_SPARSE && state->file_end != state->offset) {
+		const uint8_t zero = 0;
+		int retval = fileio_seek(state->fileio, state->offset - 1);
+		if (retval != ERROR_OK)
+			return retval;
+		return dump_image_write(state->fileio, &zero, 1);
+	}
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_dump_image_command)
 {
 	struct fileio *fileio;
@@ -3700,14 +4265,36 @@ COMMAND_HANDLER(handle_dump_image_command)
 	target_addr_t address, size;
 	struct duration bench;
 	struct target *target = get_current_target(CMD_CTX);
+	struct dump_image_state state = {
+		.format = DUMP_IMAGE_BIN,
+	};
 
-	if (CMD_ARGC != 3)
+	if (CMD_ARGC != 3 && CMD_ARGC != 4)
 		return ERROR_COMMAND_SYNTAX_ERROR;
 
 	COMMAND_PARSE_ADDRESS(CMD_ARGV[1], address);
 	COMMAND_PARSE_ADDRESS(CMD_ARGV[2], size);
 
-	uint32_t buf_size = (size > 4096) ? 4096 : size;
+	if (CMD_ARGC == 4) {
+		if (strcmp(CMD_ARGV[3], "bin") == 0) {
+			state.format = DUMP_IMAGE_BIN;
+		} else if (strcmp(CMD_ARGV[3], "sparse") == 0) {
+			state.format = DUMP_IMAGE_SPARSE;
+		} else if (strcmp(CMD_ARGV[3], "ihex") == 0) {
+			state.format = DUMP_IMAGE_IHEX;
+		} else {
+			command_print(CMD, "unknown format '%s'", CMD_ARGV[3]);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+	}
+
+	if (state.format == DUMP_IMAGE_IHEX && size > 0 &&
+			(address > UINT32_MAX || size - 1 > UINT32_MAX - address)) {
+		command_print(CMD, "Intel HEX is limited to 32-bit addresses");
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+	}
+
+	uint32_t buf_size = MIN(size, DUMP_IMAGE_MAX_CHUNK);
 	buffer = malloc(buf_size);
 	if (!buffer)
 		return ERROR_FAIL;
@@ -3717,34 +4304,53 @@ COMMAND_HANDLER(handle_dump_image_command)
 		free(buffer);
 		return retval;
 	}
+	state.fileio = fileio;
 
 	duration_start(&bench);
 
-	while (size > 0) {
-		size_t size_written;
-		uint32_t this_run_size = (size > buf_size) ? buf_size : size;
-		retval = target_read_buffer(target, address, this_run_size, buffer);
+	/*
+	 * The file is written through the stdio and OS caches, which flush it
+	 * to the disk while the next chunk is read from the target. Large
+	 * chunks amortize the queue flushes, but a slow adapter must not keep
+	 * the servers waiting for seconds, so the chunk size follows the
+	 * measured read time.
+	 */
+	uint32_t chunk_size = MIN(buf_size, DUMP_IMAGE_MIN_CHUNK);
+	target_addr_t dumped = 0;
+	while (dumped < size) {
+		uint32_t this_run_size = MIN(size - dumped, chunk_size);
+
+		int64_t start = timeval_ms();
+		retval = target_read_buffer(target, address + dumped, this_run_size, buffer);
 		if (retval != ERROR_OK)
 			break;
+		int64_t elapsed = timeval_ms() - start;
 
-		retval = fileio_write(fileio, this_run_size, buffer, &size_written);
+		retval = dump_image_store(&state, address + dumped, buffer, this_run_size);
 		if (retval != ERROR_OK)
 			break;
 
-		size -= this_run_size;
-		address += this_run_size;
+		dumped += this_run_size;
+
+		if (elapsed < DUMP_IMAGE_CHUNK_MS / 2 && chunk_size < buf_size)
+			chunk_size = MIN(2 * chunk_size, buf_size);
+		else if (elapsed > 2 * DUMP_IMAGE_CHUNK_MS && chunk_size > DUMP_IMAGE_MIN_CHUNK)
+			chunk_size /= 2;
+
+		keep_alive();
 	}
 
 	free(buffer);
 
+	if (retval == ERROR_OK)
+		retval = dump_image_finish(&state);
+
 	if ((retval == ERROR_OK) && (duration_measure(&bench) == ERROR_OK)) {
-		size_t filesize;
-		retval = fileio_size(fileio, &filesize);
-		if (retval != ERROR_OK)
-			return retval;
 		command_print(CMD,
-				"dumped %zu bytes in %fs (%0.3f KiB/s)", filesize,
-				duration_elapsed(&bench), duration_kbps(&bench, filesize));
+				"dumped %zu bytes in %fs (%0.3f KiB/s)", (size_t)size,
+				duration_elapsed(&bench), duration_kbps(&bench, size));
+		if (state.format != DUMP_IMAGE_BIN)
+			command_print(CMD, "%zu bytes of blank pages skipped", state.skipped);
 	}
 
 	retvaltemp = fileio_close(fileio);
@@ -4362,6 +4968,10 @@ COMMAND_HANDLER(handle_profile_command)
 
 	assert(num_of_samples <= MAX_PROFILE_SAMPLE_NUM);
 
+	LOG_INFO("%" PRIu32 " samples in %" PRIu32 " ms (%" PRIu64 " samples/s)",
+		num_of_samples, duration_ms,
+		duration_ms ? (uint64_t)num_of_samples * 1000 / duration_ms : 0);
+
 	retval = target_poll(target);
 	if (retval != ERROR_OK) {
 		free(samples);
@@ -5086,16 +5696,29 @@ no_params:
 		case TCFG_WORK_AREA_BACKUP:
 			if (goi->isconfigure) {
 				target_free_all_working_areas(target);
-				e = jim_getopt_wide(goi, &w);
+				Jim_Obj *mode;
+				e = jim_getopt_obj(goi, &mode);
 				if (e != JIM_OK)
 					return e;
-				/* make this boolean */
-				target->backup_working_area = (w != 0);
+				if (strcmp(Jim_GetString(mode, NULL), "session") == 0) {
+					target->backup_working_area = true;
+					target->backup_working_area_session = true;
+				} else {
+					e = Jim_GetWide(goi->interp, mode, &w);
+					if (e != JIM_OK)
+						return e;
+					/* make this boolean */
+					target->backup_working_area = (w != 0);
+					target->backup_working_area_session = false;
+				}
 			} else {
 				if (goi->argc != 0)
 					goto no_params;
 			}
-			Jim_SetResult(goi->interp, Jim_NewIntObj(goi->interp, target->backup_working_area ? 1 : 0));
+			if (target->backup_working_area && target->backup_working_area_session)
+				Jim_SetResultString(goi->interp, "session", -1);
+			else
+				Jim_SetResult(goi->interp, Jim_NewIntObj(goi->interp, target->backup_working_area ? 1 : 0));
 			/* loop for more e*/
 			break;
 
@@ -5693,6 +6316,9 @@ static const struct command_registration target_instance_command_handlers[] = {
 		.help = "invoke handler for specified event",
 		.usage = "event_name",
 	},
+	{
+		.chain = target_mem_cache_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -5789,6 +6415,7 @@ static int target_create(struct jim_getopt_info *goi)
 	target->working_area_size   = 0x0;
 	target->working_areas       = NULL;
 	target->backup_working_area = false;
+	target->backup_working_area_session = false;
 
 	target->state               = TARGET_UNKNOWN;
 	target->debug_reason        = DBG_REASON_UNDEFINED;
@@ -6275,6 +6902,9 @@ static const struct command_registration target_command_handlers[] = {
 		.chain = target_subcommand_handlers,
 		.usage = "",
 	},
+	{
+		.chain = image_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -6533,6 +7163,9 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.usage = "seconds filename [start end]",
 		.help = "profiling samples the CPU PC",
 	},
+	{
+		.chain = target_profile_stream_command_handlers,
+	},
 	/** @todo don't register virt2phys() unless target supports it */
 	{
 		.name = "virt2phys",
@@ -6696,7 +7329,7 @@ static const struct command_registration target_exec_command_handlers[] = {
 		.name = "dump_image",
 		.handler = handle_dump_image_command,
 		.mode = COMMAND_EXEC,
-		.usage = "filename address size",
+		.usage = "filename address size ['bin'|'sparse'|'ihex']",
 	},
 	{
 		.name = "verify_image_checksum",
@@ -150,7 +150,10 @@ struct target {
 	target_addr_t working_area_phys;			/* physical address */
 	uint32_t working_area_size;			/* size in bytes */
 	bool backup_working_area;			/* whether the content of the working area has to be preserved */
+	bool backup_working_area_session;	/* back up the whole working area once, restore it on resume */
+	uint8_t *working_area_snapshot;		/* content of the working area before its first use */
 	struct working_area *working_areas;/* list of allocated working areas */
+	struct algorithm_cache_entry *algorithm_cache;	/* algorithms left in the working area */
 	enum target_debug_reason debug_reason;/* reason why the target entered debug state */
 	enum target_endianness endianness;	/* target endianness */
 	/* also see: target_state_name() */
@@ -207,6 +210,9 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* Host side cache of memory reads, see mem_cache.h */
+	struct target_mem_cache *mem_cache;
 };
 
 struct target_list {
@@ -733,8 +739,39 @@ int target_alloc_working_area_try(struct target *target,
  */
 int target_free_working_area(struct target *target, struct working_area *area);
 void target_free_all_working_areas(struct target *target);
+/**
+ * Write back the content of the working area saved by the session backup
+ * mode, if any. Called before the target runs user code again and when the
+ * debugger detaches. Areas still allocated keep their own backup and are
+ * restored when freed.
+ * @returns ERROR_OK if successful; error code if restore failed
+ */
+int target_restore_working_area_snapshot(struct target *target);
 uint32_t target_get_working_area_avail(struct target *target);
 
+/**
+ * Allocate a working area and load an algorithm into it.
+ * The code stays in the working area when the algorithm is freed, a later
+ * call with the same code gets the same area back without downloading it
+ * again. The cached algorithms are dropped when the target resumes, steps,
+ * is reset, when their memory is written and when the working area runs
+ * out of space.
+ * @param target
+ * @param code Code of the algorithm, in target byte order
+ * @param size Size of the code in bytes
+ * @param area Pointer to the area allocated for the algorithm
+ * @returns ERROR_OK if successful; error code otherwise
+ */
+int target_alloc_algorithm(struct target *target, const uint8_t *code,
+		uint32_t size, struct working_area **area);
+/**
+ * Release an algorithm allocated by target_alloc_algorithm().
+ * @param target
+ * @param area Area of the algorithm or NULL
+ * @returns ERROR_OK if successful; error code if restore failed
+ */
+int target_free_algorithm(struct target *target, struct working_area *area);
+
 /**
  * Free all the resources allocated by targets and the target layer
  */
@@ -784,6 +821,14 @@ void target_handle_md_output(struct command_invocation *cmd,
 int target_profiling_default(struct target *target, uint32_t *samples, uint32_t
 		max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+/**
+ * Read program counter samples without halting the target.
+ *
+ * Returns ERROR_NOT_IMPLEMENTED if the target has no way to do so.
+ */
+int target_sample_pc(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples);
+
 #define ERROR_TARGET_INVALID	(-300)
 #define ERROR_TARGET_INIT_FAILED (-301)
 #define ERROR_TARGET_TIMEOUT	(-302)
@@ -300,6 +300,12 @@ struct target_type {
 	int (*profiling)(struct target *target, uint32_t *samples,
 			uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds);
 
+	/* read up to max_num_samples PC samples without halting the target,
+	 * e.g. from a PC sampling register. A sample of 0xffffffff means that
+	 * no PC was available (core halted or sleeping). */
+	int (*sample_pc)(struct target *target, uint32_t *samples,
+			uint32_t max_num_samples, uint32_t *num_samples);
+
 	/* Return the number of address bits this target supports. This will
 	 * typically be 32 for 32-bit targets, and 64 for 64-bit targets. If not
 	 * implemented, it's assumed to be 32. */